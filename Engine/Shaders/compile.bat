@@ -1,7 +1,34 @@
 SET spec_height=1024
 
 C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V sum.comp -o sum.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_IN -DFP16_OUT sum.comp -o sum_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_IN sum.comp -o sum_fp16_last.spv
 C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V sdft.comp -o sdft.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_OUT sdft.comp -o sdft_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DRADIX=4 sdft_radix.comp -o sdft4.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DRADIX=4 -DFP16_OUT sdft_radix.comp -o sdft4_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DRADIX=8 sdft_radix.comp -o sdft8.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DRADIX=8 -DFP16_OUT sdft_radix.comp -o sdft8_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V sdft_shared.comp -o sdft_shared.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_OUT sdft_shared.comp -o sdft_shared_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V rfft_split.comp -o rfft_split.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V sdft_sliding.comp -o sdft_sliding.spv
 C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V filter.comp -o filter.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_OUT -DFP16_FILTERS filter.comp -o filter_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V --target-env vulkan1.1 filter_subgroup.comp -o filter_subgroup.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V --target-env vulkan1.1 -DFP16_FILTERS filter_subgroup.comp -o filter_subgroup_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V filter_tiled.comp -o filter_tiled.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_FILTERS filter_tiled.comp -o filter_tiled_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V filter_window.comp -o filter_window.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_FILTERS filter_window.comp -o filter_window_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V ols_pack.comp -o ols_pack.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V -DFP16_FILTERS ols_pack.comp -o ols_pack_fp16.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V ols_mac.comp -o ols_mac.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V ols_blend.comp -o ols_blend.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V stft_frame.comp -o stft_frame.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V stft_mask.comp -o stft_mask.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V stft_ola.comp -o stft_ola.spv
 C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V read.comp -o read.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V pcm_peak.comp -o pcm_peak.spv
+C:\VulkanSDK\1.3.243.0\Bin\glslangValidator.exe -V pcm_expand.comp -o pcm_expand.spv
 pause
\ No newline at end of file
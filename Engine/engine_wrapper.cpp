@@ -16,7 +16,17 @@ void SDFTFilterInit(int hostMaskHeight, int hostMaskWidth, int hop, int specHeig
 		// .max_signal_size = 16 * 1024 * 40,  // 40 sec @ 16kbps
 		.hop = hop,
 		.hostMaskHeight = hostMaskHeight,
-		.hostMaskWidth = hostMaskWidth
+		.hostMaskWidth = hostMaskWidth,
+		.fft_radix = FFT_RADIX,
+		.real_fft = hop % 2 == 0 ? REAL_FFT : 0,		// Samples are packed in pairs, an odd hop falls back to the complex path
+		.fir_engine = FIR_ENGINE,
+		.filter_tolerance = FILTER_TOLERANCE,
+		.process_mode = PROCESS_MODE,
+		.sdft_engine = SDFT_ENGINE,
+		.batch_size = SPEC_BATCH,
+		.memory_placement = MEMORY_PLACEMENT,
+		.storage_precision = STORAGE_PRECISION,
+		.memory_budget = MEMORY_BUDGET
 	};
 	std::vector<const char*> extensions = {"VK_KHR_surface", "VK_KHR_win32_surface"};
 	context = setupContext(extensions);
@@ -27,6 +37,88 @@ void SDFTFilterUpdate(int* mask, const std::vector<float>& signalIn, std::vector
 	filter->update(mask, signalIn, signalOut);
 }
 
+void SDFTFilterUpdateAndAnalyze(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut, std::vector<float>& specOut) {
+	filter->updateAndAnalyze(mask, signalIn, signalOut, specOut);
+}
+
 void calcSDFT(const std::vector<float>& signalIn, std::vector<float>& specOut) {
 	filter->calcSDFT(signalIn, specOut);
+}
+
+void calcSDFTBatch(const std::vector<float>& signalIn, int count, std::vector<float>& specOut) {
+	filter->calcSDFTBatch(signalIn, count, specOut);
+}
+
+int SDFTFilterGetBatchSize() {
+	return filter->getBatchSize();
+}
+
+void SDFTFilterComputeSpectrogram(const std::vector<float>& signalIn, float* specOut) {
+	filter->computeSpectrogram(signalIn, specOut);
+}
+
+int SDFTFilterGetSpectrogramColumns(int signalLength) {
+	return filter->getSpectrogramColumns(signalLength);
+}
+
+float SDFTFilterGetError() {
+	return filter->getFilterError();
+}
+
+int SDFTFilterGetTaps() {
+	return filter->getFilterTaps();
+}
+
+void SDFTFilterSetMode(int mode) {
+	filter->setProcessMode(mode);
+}
+
+uint64_t SDFTFilterSubmit(int* mask, const std::vector<float>& signalIn) {
+	return filter->submitUpdate(mask, signalIn);
+}
+
+bool SDFTFilterPoll(uint64_t ticket) {
+	return filter->poll(ticket);
+}
+
+// Interleaved real and imaginary parts
+float* SDFTFilterStageUpdate() {
+	return (float*)filter->stageUpdate();
+}
+
+uint64_t SDFTFilterCommitUpdate(int* mask) {
+	return filter->commitUpdate(mask);
+}
+
+void SDFTFilterWait(uint64_t ticket, std::vector<float>& signalOut) {
+	filter->wait(ticket, signalOut);
+}
+
+void SDFTFilterProcessSignal(int* mask, int maskColumns, const std::vector<float>& signalIn, std::vector<float>& signalOut) {
+	filter->processSignal(mask, maskColumns, signalIn, signalOut);
+}
+
+int SDFTFilterGetChunkCount(int signalLength) {
+	return filter->getChunkCount(signalLength);
+}
+
+void SDFTFilterLoadSignal(const std::vector<float>& signalIn) {
+	filter->loadSignal(signalIn);
+}
+
+// Converted and optionally normalized on the GPU
+void SDFTFilterLoadSignalInt16(const int16_t* samples, size_t count, bool normalize) {
+	filter->loadSignal(samples, count, PCM_INT16, normalize);
+}
+
+void SDFTFilterLoadSignalFloat(const float* samples, size_t count, bool normalize) {
+	filter->loadSignal(samples, count, PCM_FLOAT32, normalize);
+}
+
+void SDFTFilterUpdateAt(int* mask, int chunkIndex, std::vector<float>& signalOut) {
+	filter->updateAt(mask, chunkIndex, signalOut);
+}
+
+void SDFTFilterUpdateAndAnalyzeAt(int* mask, int chunkIndex, std::vector<float>& signalOut, std::vector<float>& specOut) {
+	filter->updateAndAnalyzeAt(mask, chunkIndex, signalOut, specOut);
 }
\ No newline at end of file
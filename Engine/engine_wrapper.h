@@ -1,10 +1,42 @@
 #pragma once
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 #include "dlib_export.h"
 
 #define SPEC_HEIGHT 1024
 #define SEGMENT_WIDTH 32
+#define FFT_RADIX 8
+#define REAL_FFT 1
+#define FIR_ENGINE FIR_OVERLAP_SAVE		// FIR_DIRECT to compare against the direct convolution
+#define FILTER_TOLERANCE 0.0f			// Share of the filter energy FIR_TILED and subgroup FIR_DIRECT may skip, 0 keeps all taps
+#define PROCESS_MODE PROCESS_FIR		// PROCESS_STFT_MASK applies the mask to the STFT directly
+#define SDFT_ENGINE SDFT_AUTO			// SDFT_FFT or SDFT_RECURSIVE to force the spectrogram engine
+#define SPEC_BATCH 8					// Chunks per calcSDFTBatch dispatch
+#define MEMORY_PLACEMENT MEMORY_AUTO	// MEMORY_STAGED or MEMORY_DIRECT to force the staging copies on or off
+#define STORAGE_PRECISION STORAGE_FP32	// STORAGE_FP16 stores the filters and the FIR_DIRECT tree partial sums as half floats, a quarter of their memory
+#define MEMORY_BUDGET (64ull << 20)		// FIR_DIRECT scratch per chunk in bytes, 0 runs the whole chunk in one tile
 
 DLIB_EXPORT void SDFTFilterInit(int hostMaskHeight, int hostMaskWidth, int hop, int specHeight);
 DLIB_EXPORT void SDFTFilterUpdate(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut);
-DLIB_EXPORT void calcSDFT(const std::vector<float>& signalIn, std::vector<float>& specOut);
\ No newline at end of file
+DLIB_EXPORT void SDFTFilterUpdateAndAnalyze(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut, std::vector<float>& specOut);
+DLIB_EXPORT void calcSDFT(const std::vector<float>& signalIn, std::vector<float>& specOut);
+DLIB_EXPORT void calcSDFTBatch(const std::vector<float>& signalIn, int count, std::vector<float>& specOut);
+DLIB_EXPORT int SDFTFilterGetBatchSize();
+DLIB_EXPORT void SDFTFilterComputeSpectrogram(const std::vector<float>& signalIn, float* specOut);
+DLIB_EXPORT int SDFTFilterGetSpectrogramColumns(int signalLength);
+DLIB_EXPORT float SDFTFilterGetError();
+DLIB_EXPORT int SDFTFilterGetTaps();
+DLIB_EXPORT void SDFTFilterSetMode(int mode);
+DLIB_EXPORT uint64_t SDFTFilterSubmit(int* mask, const std::vector<float>& signalIn);
+DLIB_EXPORT bool SDFTFilterPoll(uint64_t ticket);
+DLIB_EXPORT float* SDFTFilterStageUpdate();
+DLIB_EXPORT uint64_t SDFTFilterCommitUpdate(int* mask);
+DLIB_EXPORT void SDFTFilterWait(uint64_t ticket, std::vector<float>& signalOut);
+DLIB_EXPORT void SDFTFilterProcessSignal(int* mask, int maskColumns, const std::vector<float>& signalIn, std::vector<float>& signalOut);
+DLIB_EXPORT int SDFTFilterGetChunkCount(int signalLength);
+DLIB_EXPORT void SDFTFilterLoadSignal(const std::vector<float>& signalIn);
+DLIB_EXPORT void SDFTFilterLoadSignalInt16(const int16_t* samples, size_t count, bool normalize);
+DLIB_EXPORT void SDFTFilterLoadSignalFloat(const float* samples, size_t count, bool normalize);
+DLIB_EXPORT void SDFTFilterUpdateAt(int* mask, int chunkIndex, std::vector<float>& signalOut);
+DLIB_EXPORT void SDFTFilterUpdateAndAnalyzeAt(int* mask, int chunkIndex, std::vector<float>& signalOut, std::vector<float>& specOut);
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <vulkan/vulkan.h>
 #include <vector>
 #include <list>
+#include <map>
 #include <glm.hpp>
 #include "VulkanCommon.h"
 
@@ -13,7 +14,57 @@
 //};
 #define SUMMATION_SIZE 32
 #define SUMMATION_WIDTH 32
+#define SHARED_FFT_MAX_HEIGHT 4096		// Largest spec_height transformed in one workgroup by sdft_shared.comp
+#define CHUNK_RING_SIZE 3				// Chunks in flight by default: one uploading, one filtering, one downloading
 
+// SDFTProps::fir_engine
+#define FIR_DIRECT 0					// filter.comp + sum.comp reduction
+#define FIR_OVERLAP_SAVE 1				// Uniformly partitioned overlap-save convolution
+#define FIR_TILED 2						// Direct convolution over shared memory tiles, filter_tiled.comp
+
+// SDFTProps::sdft_engine
+#define SDFT_AUTO 0						// Recursive for hops short against the FFT cost, FFT otherwise
+#define SDFT_FFT 1						// Every column transformed on its own
+#define SDFT_RECURSIVE 2				// Column 0 transformed, the rest slid by sdft_sliding.comp
+
+// SDFTProps::memory_placement
+#define MEMORY_AUTO 0					// Direct on integrated, software and resizable BAR devices, staged otherwise
+#define MEMORY_STAGED 1					// Host visible staging buffers copied to and from device local ones
+#define MEMORY_DIRECT 2					// Shader input and output buffers in device local, host visible memory
+
+// SDFTProps::storage_precision
+#define STORAGE_FP32 0
+#define STORAGE_FP16 1					// Filters and FIR_DIRECT tree partial sums stored as half floats, needs 16-bit storage buffers
+
+// SDFTProps::direct_reduce
+#define REDUCE_AUTO 0					// filter_subgroup.comp when the device has subgroup arithmetic, the tree otherwise
+#define REDUCE_TREE 1					// filter.comp + sum.comp tree whatever the device
+
+// Chunk timeline values, counted from the value the chunk held when the job was submitted
+#define STAGE_UPLOADED 1				// Signal staged into device buffers, both jobs
+#define STAGE_SPEC_PROCESSED 2			// calcSDFT job
+#define STAGE_SPEC_DOWNLOADED 3
+#define STAGE_MASK_READ 2				// Filtering job
+#define STAGE_FILTERS_READY 3			// Skipped by the STFT masking mode
+#define STAGE_FILTERED 4
+#define STAGE_DOWNLOADED 5
+#define STAGE_ANALYZED 5				// updateAndAnalyze replaces the download with the filtered signal analysis
+#define STAGE_ANALYSIS_DOWNLOADED 6
+#define STAGE_COUNT 7
+
+// loadSignal sample formats, converted on the device
+#define PCM_FLOAT32 0
+#define PCM_INT16 1						// Full scale at 32768
+
+// SDFTFilter::setProcessMode
+#define PROCESS_FIR 0					// Mask is turned into FIR filters convolved with the signal
+#define PROCESS_STFT_MASK 1				// Mask multiplies the signal STFT, inverse STFT with overlap-add
+
+
+struct ComputeQueue {
+	VkQueue queue;
+	int familyIdx;
+};
 
 // Mimics SDFTFilterState
 struct SDFTProps {
@@ -25,6 +76,20 @@ struct SDFTProps {
 
 	int hostMaskHeight;
 	int hostMaskWidth;
+
+	int fft_radix;				// 2, 4 or 8. Highest radix used by the FFT stages, 0 means 2
+	int real_fft;				// 1 - forward spectrogram uses the real-input transform and keeps spec_height/2+1 bins
+	int fir_engine;				// FIR_DIRECT, FIR_OVERLAP_SAVE or FIR_TILED
+	float filter_tolerance;		// > 0 - FIR_TILED and the subgroup FIR_DIRECT path skip the outer taps holding up to this share of the filter energy.
+								// The tree and overlap-save engines evaluate every tap and reject it
+	int process_mode;			// PROCESS_FIR or PROCESS_STFT_MASK, initial mode of update()
+	int sdft_engine;			// SDFT_AUTO, SDFT_FFT or SDFT_RECURSIVE, forward spectrogram of calcSDFT
+	int ring_size;				// Chunk resource sets cycled by updateRing, 0 means CHUNK_RING_SIZE
+	int batch_size;				// Consecutive chunks transformed by one calcSDFTBatch dispatch, 0 means 1
+	int memory_placement;		// MEMORY_AUTO, MEMORY_STAGED or MEMORY_DIRECT
+	int storage_precision;		// STORAGE_FP32 or STORAGE_FP16
+	VkDeviceSize memory_budget;	// Bytes of FIR_DIRECT scratch per chunk, the filter + sum tree runs in output tiles fitting it. 0 - one tile
+	int direct_reduce;			// REDUCE_AUTO or REDUCE_TREE, FIR_DIRECT reduction
 };
 
 struct SDFTState {
@@ -34,6 +99,31 @@ struct SDFTState {
 	int isInverse;
 	int isShift;
 	int specHeight;
+	int inBatchStride;			// Elements between the inputs of consecutive batched chunks, dispatch z picks the chunk
+	int outBatchStride;
+};
+
+// Mimics the sdft shaders specialization constants
+struct FFTSpecialization {
+	int specHeight;
+	int stageStride;
+	int twiddleStep;
+};
+
+// Mimics the sdft_sliding.comp specialization constants
+struct SlidingSpecialization {
+	int specHeight;
+	int columns;
+	int isPacked;
+};
+
+// Pipelines transforming columns of one length
+struct FFTPlan {
+	int height;
+	bool isShared;							// Whole column fits into the workgroup shared memory
+	std::vector<int> stages;				// Radix of every stage
+	std::vector<VkPipeline> pipelines;		// One specialized pipeline per stage
+	VkPipeline sharedPipeline;
 };
 
 struct LinearResize {
@@ -47,6 +137,7 @@ struct FIRState {
 	int signal_len;
 	int hop;
 	int spec_height;
+	int tile_offset;			// First output sample of the filter.comp tile
 };
 
 struct SUMState {
@@ -54,6 +145,48 @@ struct SUMState {
 	int out_stride;
 	int spec_height;
 	int signal_len;
+	int out_offset;				// Output rows before the tile, set for the last stage only
+};
+
+// Mimics FilterWindow of the filter shaders, one per filter column
+struct FilterWindow {
+	int halfTaps;				// Taps [spec_height/2 - halfTaps, spec_height/2 + halfTaps) are evaluated
+	float error;				// Relative energy of the dropped taps
+};
+
+struct WindowState {
+	int spec_height;
+	float tolerance;
+};
+
+// Mimics STFTState of the stft_* shaders
+struct STFTState {
+	int signal_len;
+	int hop;
+	int spec_height;
+	int segment_width;
+	int frames;				// Analysis frames hop apart covering the extended signal
+};
+
+// Mimics OLSState of the ols_* shaders
+struct OLSState {
+	int signal_len;
+	int hop;
+	int spec_height;
+	int segment_width;
+	int block_size;			// Filter partition and output block length, spec_height/2
+	int partitions;			// Partitions per filter column
+	int block_columns;		// Filter columns crossfaded within one output block, at most
+	int blocks;				// Output blocks covering signal_len
+};
+
+// Mimics PCMState of the pcm_* shaders
+struct PCMState {
+	int count;				// Samples in the upload
+	int format;				// PCM_FLOAT32 or PCM_INT16
+	int pad;				// Zeros in front of the first sample
+	int track_len;			// Complex samples written, padding included
+	int is_normalize;		// Scale to unit peak
 };
 
 // Returned by update(int chunk)
@@ -80,6 +213,15 @@ struct Chunk {
 	std::pair<VkBuffer, VkDeviceMemory> signalRawExtBuffer;
 	std::pair<VkBuffer, VkDeviceMemory> signalFiltBuffer;
 	std::pair<VkBuffer, VkDeviceMemory> filtersBuffer;
+	std::pair<VkBuffer, VkDeviceMemory> filterWindowBuffer;			// Host visible, read back for the error report
+	// Overlap-save engine
+	std::pair<VkBuffer, VkDeviceMemory> olsFilterPartsBuffer;
+	std::pair<VkBuffer, VkDeviceMemory> olsFilterSpecBuffer;
+	std::pair<VkBuffer, VkDeviceMemory> olsSignalSpecBuffer;		// Reused for the block outputs after the multiply
+	std::pair<VkBuffer, VkDeviceMemory> olsProductBuffer;
+	// STFT masking
+	std::pair<VkBuffer, VkDeviceMemory> stftFramesBuffer;
+	std::pair<VkBuffer, VkDeviceMemory> stftSpecBuffer;
 	// Transfer
 	std::pair<VkBuffer, VkDeviceMemory> uploadBuffer;
 	std::pair<VkBuffer, VkDeviceMemory> bufferSignal;
@@ -99,6 +241,13 @@ struct Chunk {
 	Binding signalRawExtBinding;
 	Binding signalFiltBinding;
 	Binding filtersBinding;
+	Binding filterWindowBinding;
+	Binding stftFramesBinding;
+	Binding stftSpecBinding;
+	Binding olsFilterPartsBinding;
+	Binding olsFilterSpecBinding;
+	Binding olsSignalSpecBinding;
+	Binding olsProductBinding;
 
 	// Descriptor sets
 	std::pair <VkDescriptorSet, VkDescriptorPool> srcDSet;
@@ -113,6 +262,17 @@ struct Chunk {
 	std::pair <VkDescriptorSet, VkDescriptorPool> filterDSet;
 	std::pair <VkDescriptorSet, VkDescriptorPool> maskHostDSet;
 	std::pair <VkDescriptorSet, VkDescriptorPool> filteredDSet;
+	std::pair <VkDescriptorSet, VkDescriptorPool> filterWindowDSet;
+	std::pair <VkDescriptorSet, VkDescriptorPool> stftFramesDSet;
+	std::pair <VkDescriptorSet, VkDescriptorPool> stftSpecDSet;
+	std::pair <VkDescriptorSet, VkDescriptorPool> olsFilterPartsDSet;
+	std::pair <VkDescriptorSet, VkDescriptorPool> olsFilterSpecDSet;
+	std::pair <VkDescriptorSet, VkDescriptorPool> olsSignalSpecDSet;
+	std::pair <VkDescriptorSet, VkDescriptorPool> olsProductDSet;
+
+	// Compute queue running every compute stage of the chunk, its command pool belongs to the queue family
+	VkQueue computeQueue;
+	int computeFamilyIdx;
 
 	// Commands - SDFT
 	VkPipelineStageFlags waitStagesCompute;
@@ -122,23 +282,68 @@ struct Chunk {
 	VkCommandBuffer cmdBuffUploadSDFT;
 	VkCommandBuffer cmdBuffDowndloadSDFT;
 	VkCommandBuffer cmdBuffProcessSDFT;
-	VkSemaphore smphUploadedSDFT;
-	VkSemaphore smphProcessedSDFT;
 	VkSubmitInfo submitInfoSDFTUpload;
 	VkSubmitInfo submitInfoSDFTDownload;
 	VkSubmitInfo submitInfoSDFTProcess;
-	VkFence fenceSDFT;
+	VkTimelineSemaphoreSubmitInfo timelineSDFTUpload;
+	VkTimelineSemaphoreSubmitInfo timelineSDFTDownload;
+	VkTimelineSemaphoreSubmitInfo timelineSDFTProcess;
+
+	// Commands - batched SDFT, batch_size consecutive chunks per replay. Recorded when batch_size > 1
+	VkCommandBuffer cmdBuffUploadSpecBatch;
+	VkCommandBuffer cmdBuffDownloadSpecBatch;
+	VkCommandBuffer cmdBuffProcessSpecBatch;
+	VkSubmitInfo submitInfoSpecBatchUpload;
+	VkSubmitInfo submitInfoSpecBatchDownload;
+	VkSubmitInfo submitInfoSpecBatchProcess;
+	VkTimelineSemaphoreSubmitInfo timelineSpecBatchUpload;
+	VkTimelineSemaphoreSubmitInfo timelineSpecBatchDownload;
+	VkTimelineSemaphoreSubmitInfo timelineSpecBatchProcess;
 
 	// Commands - Filtering
+	VkCommandBuffer cmdBuffUploadSignal;
+	VkCommandBuffer cmdBuffDownloadSignal;
+	VkCommandBuffer cmdBuffTrackCopy;						// Recorded per job with the offset of the chunk in the loaded track
 	VkCommandBuffer cmdBuffMaskRead;
 	VkCommandBuffer cmdBuffMaskSDFT;
 	VkCommandBuffer cmdBuffFilter;
-	VkSemaphore smphMaskRead;
-	VkSemaphore smphFiltersRdy;
+	VkSubmitInfo submitInfoSignalUpload;
+	VkSubmitInfo submitInfoTrackCopy;
+	VkSubmitInfo submitInfoSignalDownload;
 	VkSubmitInfo submitInfoMaskRead;
 	VkSubmitInfo submitInfoFilter;
 	VkSubmitInfo submitInfoMaskSDFT;
-	VkFence fenceFilter;
+	VkTimelineSemaphoreSubmitInfo timelineSignalUpload;
+	VkTimelineSemaphoreSubmitInfo timelineTrackCopy;
+	VkTimelineSemaphoreSubmitInfo timelineSignalDownload;
+	VkTimelineSemaphoreSubmitInfo timelineMaskRead;
+	VkTimelineSemaphoreSubmitInfo timelineFilter;
+	VkTimelineSemaphoreSubmitInfo timelineMaskSDFT;
+
+	// Commands - spectrogram of the filtered signal, replaces the signal download in updateAndAnalyze
+	VkCommandBuffer cmdBuffAnalyze;
+	VkCommandBuffer cmdBuffDownloadAnalysis;
+	VkSubmitInfo submitInfoAnalyze;
+	VkSubmitInfo submitInfoAnalysisDownload;
+	VkTimelineSemaphoreSubmitInfo timelineAnalyze;
+	VkTimelineSemaphoreSubmitInfo timelineAnalysisDownload;
+
+	// Commands - STFT masking, waits for the mask read
+	VkCommandBuffer cmdBuffSTFT;
+	VkSubmitInfo submitInfoSTFT;
+	VkTimelineSemaphoreSubmitInfo timelineSTFT;
+
+	// Staging memory mapped for the chunk lifetime, the device buffers themselves with direct IO
+	void* uploadMapped;
+	int* maskHostMapped;
+	glm::vec2* signalMapped;
+	void* specMapped;
+	glm::vec2* rawMapped;		// Direct IO only, the host fills signalRaw itself
+
+	// Every stage of the running job signals the timeline, the next one waits for it
+	VkSemaphore timeline;
+	uint64_t stageValues[STAGE_COUNT];			// Absolute STAGE_* values of the running job
+	uint64_t ticket;							// Filtering job not collected yet, 0 if none
 };
 
 class SDFTFilter
@@ -147,7 +352,9 @@ public:
 	SDFTFilter(SDFTProps props);
 	SDFTFilter(VulkanContext context, SDFTProps props);
 	~SDFTFilter();
-	Chunk chunk;
+	// Ring of independent resource sets, the submit infos point into them so it is never resized
+	std::vector<Chunk> chunks;
+	void initQueues();
 	void initChunk(Chunk& chunk);
 	void recordChunk(Chunk& chunk);
 	void destroyChunk(Chunk& chunk);
@@ -157,13 +364,74 @@ public:
 	/// Reads mask from the data array, calculates filters, applies them to the signal,
 	/// calculates the spectrogram of the filtered signal
 	/// </summary>
-	/// <param name="chunk">Index of a chunk to update</param>
-	/// <param name="data">Pointer to the mask data, stored in ARGB format. 4-bytes int for every pixel</param>
-	/// <returns></returns>
-	void update(Chunk& chunk, int* data);
+	/// <param name="mask">Pointer to the mask data, stored in ARGB format. 4-bytes int for every pixel</param>
+	/// <param name="signalIn">hop * segment_width + 2 * spec_height samples</param>
+	/// <param name="signalOut">hop * segment_width + spec_height filtered samples</param>
 	void update(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut);
+	// update() followed by calcSDFT of the filtered signal, which stays on the device between them.
+	// specOut gets segment_width full shifted columns
+	void updateAndAnalyze(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut, std::vector<float>& specOut);
+	// Non-blocking update: queues the chunk and returns its ticket. A ring slot whose result was not taken
+	// yet is waited for and its result kept until wait() asks for it
+	uint64_t submitUpdate(int* mask, const std::vector<float>& signalIn);
+	// submitUpdate without the signal copy: stageUpdate hands out the mapped upload memory of the next ring slot,
+	// hop * segment_width + 2 * spec_height complex samples with zero imaginary parts, commitUpdate submits it.
+	// No other engine call may come in between
+	glm::vec2* stageUpdate();
+	uint64_t commitUpdate(int* mask);
+	// True once the ticket's filtered signal is downloaded
+	bool poll(uint64_t ticket);
+	// Blocks until the ticket is done and hands out its filtered signal, every ticket is waited once
+	void wait(uint64_t ticket, std::vector<float>& signalOut);
+	// Filters consecutive chunks with up to ring_size of them in flight, signalsOut[i] gets the result of signalsIn[i]
+	void updateRing(const std::vector<int*>& masks, const std::vector<std::vector<float>>& signalsIn, std::vector<std::vector<float>>& signalsOut);
+	/// <summary>
+	/// Filters a whole signal, chunk by chunk with up to ring_size of them in flight
+	/// </summary>
+	/// <param name="mask">Full-width mask, segment_width columns of hostMaskHeight pixels per chunk, chunk after chunk</param>
+	/// <param name="maskColumns">Columns in the mask, at least getChunkCount(signalIn.size()) * segment_width</param>
+	/// <param name="signalIn">Unpadded signal, zeros are assumed outside it</param>
+	/// <param name="signalOut">Filtered signal of the same length</param>
+	void processSignal(int* mask, int maskColumns, const std::vector<float>& signalIn, std::vector<float>& signalOut);
+	// Chunks covering signalLength samples, each filters hop * segment_width + spec_height of them
+	int getChunkCount(int signalLength);
+	// Uploads the whole unpadded signal once, the *At calls then filter its chunks without any signal upload.
+	// Replaces the previously loaded signal
+	void loadSignal(const std::vector<float>& signalIn);
+	/// <summary>
+	/// loadSignal of raw samples uploaded as they are, widening and normalization run on the device
+	/// </summary>
+	/// <param name="samples">count samples of format, int16 ones take half the upload of float32</param>
+	/// <param name="format">PCM_FLOAT32 or PCM_INT16</param>
+	/// <param name="isNormalize">Scale the signal so its peak magnitude is 1</param>
+	void loadSignal(const void* samples, size_t count, int format, bool isNormalize);
+	int getTrackChunks();
+	// update, submitUpdate and updateAndAnalyze of chunk chunkIndex of the loaded signal, laid out as in processSignal
+	uint64_t submitUpdateAt(int* mask, int chunkIndex);
+	void updateAt(int* mask, int chunkIndex, std::vector<float>& signalOut);
+	void updateAndAnalyzeAt(int* mask, int chunkIndex, std::vector<float>& signalOut, std::vector<float>& specOut);
+	// PROCESS_FIR or PROCESS_STFT_MASK. The first switch to PROCESS_STFT_MASK waits for the chunks in flight and rebuilds them
+	void setProcessMode(int mode);
 	void calcSDFT(const std::vector<float>& signalIn, std::vector<float>& specOut);
+	/// <summary>
+	/// Spectrogram of count consecutive chunks in one dispatch, chunk i starts hop * segment_width * i samples into signalIn
+	/// </summary>
+	/// <param name="signalIn">Up to hop * segment_width * count + 2 * spec_height samples, zero padded</param>
+	/// <param name="count">1 to batch_size chunks</param>
+	/// <param name="specOut">segment_width columns per chunk</param>
+	void calcSDFTBatch(const std::vector<float>& signalIn, int count, std::vector<float>& specOut);
+	int getBatchSize();
+	/// <summary>
+	/// Spectrogram of a whole signal, batches of batch_size chunks pipelined over the ring
+	/// </summary>
+	/// <param name="signalIn">Unpadded signal, zeros are assumed outside it</param>
+	/// <param name="specOut">spec_height magnitudes for each of getSpectrogramColumns(signalIn.size()) columns, column t centered on sample t * hop</param>
+	void computeSpectrogram(const std::vector<float>& signalIn, float* specOut);
+	int getSpectrogramColumns(int signalLength);
 	int getSpecWidth();
+	// Largest relative energy dropped from a filter column and the widest window, as of the last update
+	float getFilterError();
+	int getFilterTaps();
 
 private:
 	SDFTProps props;
@@ -177,13 +445,69 @@ private:
 
 	// DEVICE RELATED (move to context?)
 	VkQueue transferQueue;
-	VkQueue readMaskQueue;
-	VkQueue filterQueue;
-	// sdft performing queues
-	VkQueue rawSDFTQueue;
-	VkQueue filteredSDFTQueue;
-	VkQueue createFilterQueue;
+	VkQueue downloadQueue;		// Second transfer queue when there is one, so downloads do not hold back uploads
+	// Every compute queue of the device, chunks are spread over them by initQueues
+	std::vector<ComputeQueue> computeQueues;
+	// Every buffer of the filter lives in its blocks
+	MemoryPool memoryPool;
+	DescriptorAllocator descriptorAllocator;
+
+	// Families the chunk buffers are shared between, concurrent sharing when there are several
+	std::vector<uint32_t> bufferFamilies;
+	// calcSDFT takes the chunks in turn, so consecutive spectrogram jobs land on different queues
+	int nextSpecChunk;
+
+
+	// Complex spec_height transform and the spec_height/2 transform of the real-input path
+	FFTPlan fft;
+	FFTPlan realFFT;
+	// Inverse mask transform writing half float filters, the fft plan with the _fp16 shaders on its last stage. Built with isHalfStorage
+	FFTPlan filterFFT;
+
+	// Tickets are handed out in order, ticket t runs on chunks[t % chunks.size()]
+	uint64_t nextTicket;
+	std::map<uint64_t, std::vector<float>> finishedTickets;
+
+	bool isUpdateStaged;
+
+	// Signal of loadSignal as padded complex samples, device local
+	std::pair<VkBuffer, VkDeviceMemory> trackBuffer;
+	Binding trackBinding;
+	std::pair <VkDescriptorSet, VkDescriptorPool> trackDSet;
+	int trackChunks;
+
+	// Chunks per calcSDFTBatch replay, the chunk spectrogram buffers are sized for them
+	int batchSize;
+
+	// Signal and spectrum buffers are mapped device memory, no staging copies are submitted
+	bool isDirectIO;
+
+	// calcSDFT slides the columns with sdft_sliding.comp instead of transforming each
+	bool isRecursiveSDFT;
+
+	// filter_subgroup.comp replaces the filter.comp + sum.comp tree
+	bool isSubgroupReduce;
+
+	// Output samples per filter.comp + sum.comp tile, filterTemp buffers hold one tile
+	int filterTileLen;
+
+	// Filters and filterTemp buffers hold float16_t real parts instead of vec2
+	bool isHalfStorage;
+
+	int processMode;
+	STFTState stft;
+
+	// Measured by filter_window.comp during the last update
+	float filterError;
+	int filterTaps;
+
+	// Overlap-save geometry, see initOverlapSave
+	OLSState ols;
 
+	// e^(-2*pi*i*m/spec_height) table shared by all FFT pipelines
+	std::pair<VkBuffer, VkDeviceMemory> twiddleBuffer;
+	Binding twiddleBinding;
+	std::pair <VkDescriptorSet, VkDescriptorPool> twiddleDSet;
 
 	// Buffers
 	VkDescriptorSetLayout sdftDescriptorSetLayout;
@@ -191,15 +515,93 @@ private:
 	VkPipelineLayout readPipelineLayout;
 	VkPipelineLayout filterPipelineLayout;
 	VkPipelineLayout sumPipelineLayout;
+	VkPipelineLayout olsPipelineLayout;
+	VkPipelineLayout windowPipelineLayout;
+	VkPipelineLayout stftPipelineLayout;
+	VkPipelineLayout pcmPipelineLayout;
 
 	// Pipelines
-	VkPipeline sdftPipeline;
+	VkPipeline rfftSplitPipeline;
+	VkPipeline sdftSlidingPipeline;
 	VkPipeline sdftImgPipeline;
 	VkPipeline filterPipeline;
+	VkPipeline filterSubgroupPipeline;
+	VkPipeline filterTiledPipeline;
+	VkPipeline filterWindowPipeline;
+	VkPipeline stftFramePipeline;
+	VkPipeline stftMaskPipeline;
+	VkPipeline stftOlaPipeline;
 	VkPipeline sumPipeline;
+	VkPipeline sumLastPipeline;			// Half precision partial sums into the fp32 signal, VK_NULL_HANDLE without isHalfStorage
 	VkPipeline readMaskPipeline;
+	VkPipeline olsPackPipeline;
+	VkPipeline olsMacPipeline;
+	VkPipeline olsBlendPipeline;
+	VkPipeline pcmPeakPipeline;
+	VkPipeline pcmExpandPipeline;
 	void createDescriptorSets();
+	void createTwiddles();
 	void createStorageBuffer(VkDeviceSize size, std::pair<VkBuffer, VkDeviceMemory>& buffer, Binding& binding, bool is_host_visible=false);
-	void recordSDFT(VkCommandBuffer commandBuffer, VkDescriptorSet src, VkDescriptorSet dst, Chunk chunk, VkBuffer inBuffer, VkBuffer outBuffer, bool isInverse, bool isShift);
+	// Storage buffer the host fills or reads, host visible device memory with direct IO
+	void createIOBuffer(VkDeviceSize size, std::pair<VkBuffer, VkDeviceMemory>& buffer, Binding& binding);
+	bool chooseDirectIO();
+	// Makes the shader writes of the last stage visible to the mapped direct IO memory, isAlways for host visible buffers mapped in any placement
+	void recordHostBarrier(VkCommandBuffer commandBuffer, bool isAlways = false);
+	// Signals the upload stage from the host, the direct IO signal was written in place
+	void signalHostUpload(Chunk& chunk);
+	// Direct IO jobs end before the download stages, maps a download stage to the one the host waits for instead
+	int getHostStage(int stage);
+	std::vector<int> getFFTStages(int height);
+	void initFFTPlan(FFTPlan& plan, int height, uint32_t sharedMemorySize);
+	// lastShaders replace radixShaders on the last stage when given
+	void createFFTPipelines(FFTPlan& plan, std::vector<Shader>& radixShaders, Shader sharedShader, std::vector<Shader>* lastShaders = nullptr);
+	void destroyFFTPipelines(FFTPlan& plan);
+	VkDeviceSize getSpecBufferSize();
+	void recordRealSplit(VkCommandBuffer commandBuffer, VkDescriptorSet src, VkDescriptorSet dst, VkBuffer inBuffer, int columns = 0,
+		int batch = 1, int outBatchStride = 0);
+	bool chooseRecursiveSDFT();
+	int chooseFilterTileLen();
+	VkDeviceSize getFilterTempElementSize();
+	// filter.comp and the sum.comp tree over the output samples [offset, offset + len)
+	void recordFilterTile(Chunk& chunk, int offset, int len);
+	void recordSlidingSDFT(VkCommandBuffer commandBuffer, Chunk& chunk, int batch);
+	// Upload, forward spectrogram and download of batch consecutive chunks
+	void recordSpectrogram(Chunk& chunk, VkCommandBuffer upload, VkCommandBuffer process, VkCommandBuffer download, int batch);
+	// Stages the batch starting at sample first of the signal and submits its spectrogram without waiting
+	void submitSpectrogram(Chunk& chunk, const std::vector<float>& signalIn, long long first);
+	// Magnitudes of the downloaded columns, mirrored into full shifted columns for the real-input path
+	// isFullSpectrum - columns hold all spec_height bins whatever the real_fft setting
+	void readSpectrogram(Chunk& chunk, int columns, float* specOut, bool isFullSpectrum = false);
+	bool checkSubgroupReduce();
+	void initOverlapSave();
+	void recordOverlapSave(VkCommandBuffer commandBuffer, Chunk& chunk);
+	void recordSTFTMask(VkCommandBuffer commandBuffer, Chunk& chunk);
+	// Rebuilds the idle chunk ring into as few memory blocks as it fits
+	void compactMemory();
+	// Destroys and recreates the buffers, descriptors and commands of every chunk, the ring must be idle
+	void rebuildChunks();
+	// pcm_peak/pcm_expand, built by the first loadSignal
+	void createPCMPipelines();
+	// The STFT masking pipelines and chunk buffers are only built once PROCESS_STFT_MASK is selected, see setProcessMode
+	void createSTFTPipelines();
+	void recordSTFTChunk(Chunk& chunk);
+	// Stages the mask and the signal of a chunk and submits its upload, filtering and download without waiting
+	void submitChunk(Chunk& chunk, int* mask, const std::vector<float>& signalIn, bool isAnalyze = false);
+	// submitChunk taking chunk index of the loaded track as its signal
+	void submitTrackChunk(Chunk& chunk, int* mask, int index, bool isAnalyze);
+	void stageMask(Chunk& chunk, int* mask);
+	// Submits the upload and every later stage of the filtering job.
+	// No upload means the host staged the signal in place, see signalHostUpload
+	void submitFiltering(Chunk& chunk, VkSubmitInfo* upload, bool isAnalyze);
+	// Waits for the chunk download and reads the filtered signal back
+	void collectChunk(Chunk& chunk, std::vector<float>& signalOut, int stage = STAGE_DOWNLOADED);
+	// Parks the pending result of the chunk so it can take a new job
+	void releaseChunk(Chunk& chunk);
+	void startJob(Chunk& chunk);
+	void waitStage(Chunk& chunk, int stage);
+	VkSubmitInfo createTimelineSubmit(Chunk& chunk, VkCommandBuffer* commandBuffer, VkTimelineSemaphoreSubmitInfo& timelineInfo,
+		VkPipelineStageFlags* waitStages, int waitStage, int signalStage);
+	void recordSDFT(VkCommandBuffer commandBuffer, const FFTPlan& plan, VkDescriptorSet src, VkDescriptorSet dst, Chunk chunk, VkBuffer inBuffer, VkBuffer outBuffer, bool isInverse, bool isShift,
+		int columns = 0, int hop = 0, int batch = 1, int inBatchStride = 0, int outBatchStride = 0);
 };
 
@@ -1,11 +1,15 @@
 #pragma once
 #include <vector>
 #include <list>
+#include <map>
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <vulkan/vulkan.h>
 
+#define DESCRIPTOR_POOL_SETS 256			// Sets per DescriptorAllocator pool
+#define DESCRIPTOR_POOL_BINDINGS 4			// Storage buffers per DescriptorAllocator set, at most
+#define MEMORY_BLOCK_SIZE (64ull << 20)		// Device memory allocated per MemoryPool block, larger buffers get a block of their own
 
 struct Shader {
 	VkShaderModule shaderModule;
@@ -49,6 +53,10 @@ struct VulkanContext {
 	int graphicsFamilyIdx;
 	int sdftFamilyIdx;
 	int transferFamilyIdx;
+	int transferQueueCount;
+	int sdftQueueCount;			// Queues created on the compute families, up to 4
+	int graphicsQueueCount;
+	bool isStorage16Bit;		// storageBuffer16BitAccess enabled on the device
 
 	int specWidth;
 	int specHeight;
@@ -66,8 +74,77 @@ std::pair<VkImage, VkDeviceMemory>
 createImage(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, 
 	uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, 
 	VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
+VkDescriptorSetLayout createDescriptorSetLayout(VkDevice device, std::vector<Binding> bindingsIn);
 void createDescriptorSet(VkDevice device, std::vector<Binding> bindingsIn, std::vector<VkDescriptorSet>& descriptorSets, VkDescriptorPool *descriptorPool, VkDescriptorSetLayout* setLayout = 0);
 void createDescriptorSet(VkDevice device, std::vector<Binding> bindingsIn, VkDescriptorSet& descriptorSet, VkDescriptorPool* descriptorPool, VkDescriptorSetLayout* setLayout = 0);
 Shader getShaderModule(VkDevice device, std::string filename, VkShaderStageFlagBits stage);
 Binding createStorageImage(VulkanContext context, uint32_t width, uint32_t height);
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeBits, VkMemoryPropertyFlags properties);
+VkDeviceSize getHostVisibleDeviceHeapSize(VkPhysicalDevice physicalDevice);
+
+// Storage buffer descriptor sets out of a few shared pools instead of a pool per set.
+// Pooling only, not bindless: every buffer keeps its own set and the stages bind them as before.
+// Sets keep the std::pair<VkDescriptorSet, VkDescriptorPool> form, the pool being the one to free the set to
+class DescriptorAllocator {
+public:
+	void init(VkDevice device, uint32_t setsPerPool = DESCRIPTOR_POOL_SETS);
+	// Another pool is added when every one is full
+	std::pair<VkDescriptorSet, VkDescriptorPool> allocate(std::vector<Binding> bindings, VkDescriptorSetLayout setLayout);
+	// Null sets are ignored
+	void free(std::pair<VkDescriptorSet, VkDescriptorPool>& descriptorSet);
+	void destroy();
+
+private:
+	VkDescriptorPool addPool();
+
+	VkDevice device = VK_NULL_HANDLE;
+	uint32_t setsPerPool = DESCRIPTOR_POOL_SETS;
+	std::vector<VkDescriptorPool> pools;
+};
+
+// Places buffers in a few large vkAllocateMemory blocks per memory type instead of one allocation each.
+// Buffers keep the std::pair<VkBuffer, VkDeviceMemory> form, the memory being the shared block
+class MemoryPool {
+public:
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize = MEMORY_BLOCK_SIZE);
+	// Drop-in for createBuffer
+	std::pair<VkBuffer, VkDeviceMemory> createBuffer(std::vector<uint32_t> queueFamilyIndices, VkDeviceSize size, VkMemoryPropertyFlags properties, VkBufferUsageFlags usage);
+	// Returns the range to its block, null handles are ignored
+	void destroyBuffer(std::pair<VkBuffer, VkDeviceMemory>& buffer);
+	// Host visible blocks stay mapped for their whole life, returns the start of the buffer
+	void* map(VkBuffer buffer);
+	// Releases the blocks no buffer lives in anymore
+	void trim();
+	// True when the free ranges inside used blocks of one memory type add up to a whole block,
+	// re-creating the live buffers would then pack them into fewer blocks
+	bool isFragmented();
+	void destroy();
+	size_t getBlockCount();
+
+private:
+	struct Range {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+	struct Block {
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t memoryTypeIdx;
+		void* mapped;
+		std::list<Range> freeRanges;		// Sorted by offset, neighbours coalesced
+		int allocations;
+	};
+	struct Allocation {
+		Block* block;
+		Range range;
+	};
+	bool allocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, Range& range);
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDeviceSize blockSize = MEMORY_BLOCK_SIZE;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	std::list<Block> blocks;
+	std::map<VkBuffer, Allocation> allocations;
+};
 
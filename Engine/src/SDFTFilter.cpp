@@ -1,5 +1,6 @@
 #include "SDFTFilter.h"
 #include <chrono>
+#include <numbers>
 
 // #define PROFILING
 
@@ -12,114 +13,313 @@ SDFTFilter::SDFTFilter(SDFTProps props) : props(props)
 
 SDFTFilter::SDFTFilter(VulkanContext context, SDFTProps props) : context(context), props(props)
 {
-	vkGetDeviceQueue(context.device, context.sdftFamilyIdx, 0, &readMaskQueue);
-	vkGetDeviceQueue(context.device, context.sdftFamilyIdx, 1, &rawSDFTQueue);
-	vkGetDeviceQueue(context.device, context.sdftFamilyIdx, 2, &filteredSDFTQueue);
-	vkGetDeviceQueue(context.device, context.sdftFamilyIdx, 3, &createFilterQueue);
-	vkGetDeviceQueue(context.device, context.graphicsFamilyIdx, 2, &filterQueue);
 	vkGetDeviceQueue(context.device, context.transferFamilyIdx, 0, &transferQueue);
-
-	sdftDescriptorSetLayout = 0;
-	initChunk(chunk);
+	downloadQueue = transferQueue;
+	if (context.transferQueueCount > 1)
+		vkGetDeviceQueue(context.device, context.transferFamilyIdx, 1, &downloadQueue);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(context.physicalDevice, &deviceProperties);
+	initFFTPlan(fft, props.spec_height, deviceProperties.limits.maxComputeSharedMemorySize);
+	initFFTPlan(realFFT, props.spec_height / 2, deviceProperties.limits.maxComputeSharedMemorySize);
+	filterFFT = fft;
+	if (props.direct_reduce != REDUCE_AUTO && props.direct_reduce != REDUCE_TREE)
+		throw std::runtime_error("Unknown direct FIR reduction");
+	isSubgroupReduce = checkSubgroupReduce();
+
+	if (props.real_fft && props.hop % 2 != 0)
+		throw std::runtime_error("Real-input FFT requires an even hop");
+	if (props.fir_engine == FIR_TILED && (props.spec_height % 64 != 0 || props.segment_width != 32))
+		throw std::runtime_error("Tiled FIR requires spec_height to be a multiple of 64 and segment_width of 32");
+	// The sum.comp tree and the overlap-save partitions cover every tap whatever the window
+	if (props.filter_tolerance > 0 && (props.fir_engine == FIR_OVERLAP_SAVE || (props.fir_engine == FIR_DIRECT && !isSubgroupReduce)))
+		throw std::runtime_error("Filter tolerance requires FIR_TILED, or FIR_DIRECT on a device with subgroup arithmetic");
+
+	isRecursiveSDFT = chooseRecursiveSDFT();
+	memoryPool.init(context.device, context.physicalDevice);
+	descriptorAllocator.init(context.device);
+	isDirectIO = chooseDirectIO();
+	if (props.storage_precision != STORAGE_FP32 && props.storage_precision != STORAGE_FP16)
+		throw std::runtime_error("Unknown storage precision");
+	if (props.storage_precision == STORAGE_FP16 && !context.isStorage16Bit)
+		throw std::runtime_error("Device does not support 16-bit storage buffers");
+	isHalfStorage = props.storage_precision == STORAGE_FP16;
+	filterTileLen = chooseFilterTileLen();
+	nextTicket = 1;
+	trackBuffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	trackDSet = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	isUpdateStaged = false;
+	trackChunks = 0;
+	batchSize = props.batch_size > 0 ? props.batch_size : 1;
+
+	sdftDescriptorSetLayout = createDescriptorSetLayout(context.device, { {
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT } });
+	rfftSplitPipeline = VK_NULL_HANDLE;
+	sdftSlidingPipeline = VK_NULL_HANDLE;
+	sumLastPipeline = VK_NULL_HANDLE;
+	filterSubgroupPipeline = VK_NULL_HANDLE;
+	filterTiledPipeline = VK_NULL_HANDLE;
+	filterWindowPipeline = VK_NULL_HANDLE;
+	windowPipelineLayout = VK_NULL_HANDLE;
+	filterError = 0;
+	filterTaps = props.spec_height;
+	olsPipelineLayout = VK_NULL_HANDLE;
+	olsPackPipeline = VK_NULL_HANDLE;
+	olsMacPipeline = VK_NULL_HANDLE;
+	olsBlendPipeline = VK_NULL_HANDLE;
+	stftPipelineLayout = VK_NULL_HANDLE;
+	stftFramePipeline = VK_NULL_HANDLE;
+	stftMaskPipeline = VK_NULL_HANDLE;
+	stftOlaPipeline = VK_NULL_HANDLE;
+	pcmPipelineLayout = VK_NULL_HANDLE;
+	pcmPeakPipeline = VK_NULL_HANDLE;
+	pcmExpandPipeline = VK_NULL_HANDLE;
+	int signalLen = props.hop * props.segment_width + props.spec_height;
+	stft = {
+		.signal_len = signalLen,
+		.hop = props.hop,
+		.spec_height = props.spec_height,
+		.segment_width = props.segment_width,
+		.frames = signalLen / props.hop + 1
+	};
+	setProcessMode(props.process_mode);
+	initOverlapSave();
+	chunks.resize(props.ring_size > 0 ? props.ring_size : CHUNK_RING_SIZE);
+	nextSpecChunk = 0;
+	initQueues();
+	for (Chunk& chunk : chunks)
+		initChunk(chunk);
 	createDescriptorSets();
-	recordChunk(chunk);
+	createTwiddles();
+	for (Chunk& chunk : chunks)
+		recordChunk(chunk);
 
 }
 
 SDFTFilter::~SDFTFilter()
 {
+	// Tickets nobody waited for may still be running
+	vkDeviceWaitIdle(context.device);
 	vkDestroyPipeline(context.device, filterPipeline, 0);
+	vkDestroyPipeline(context.device, filterSubgroupPipeline, 0);
+	vkDestroyPipeline(context.device, filterTiledPipeline, 0);
+	vkDestroyPipeline(context.device, filterWindowPipeline, 0);
+	vkDestroyPipelineLayout(context.device, windowPipelineLayout, 0);
+	vkDestroyPipeline(context.device, stftFramePipeline, 0);
+	vkDestroyPipeline(context.device, stftMaskPipeline, 0);
+	vkDestroyPipeline(context.device, stftOlaPipeline, 0);
+	vkDestroyPipelineLayout(context.device, stftPipelineLayout, 0);
 	vkDestroyPipeline(context.device, readMaskPipeline, 0);
-	vkDestroyPipeline(context.device, sdftPipeline, 0);
+	destroyFFTPipelines(fft);
+	destroyFFTPipelines(realFFT);
+	destroyFFTPipelines(filterFFT);
+	vkDestroyPipeline(context.device, rfftSplitPipeline, 0);
+	vkDestroyPipeline(context.device, sdftSlidingPipeline, 0);
 	vkDestroyPipeline(context.device, sumPipeline, 0);
+	vkDestroyPipeline(context.device, sumLastPipeline, 0);
+	vkDestroyPipeline(context.device, olsPackPipeline, 0);
+	vkDestroyPipeline(context.device, olsMacPipeline, 0);
+	vkDestroyPipeline(context.device, olsBlendPipeline, 0);
+	vkDestroyPipelineLayout(context.device, olsPipelineLayout, 0);
+	vkDestroyPipeline(context.device, pcmPeakPipeline, 0);
+	vkDestroyPipeline(context.device, pcmExpandPipeline, 0);
+	vkDestroyPipelineLayout(context.device, pcmPipelineLayout, 0);
 	vkDestroyPipelineLayout(context.device, filterPipelineLayout, 0);
 	vkDestroyPipelineLayout(context.device, readPipelineLayout, 0);
 	vkDestroyPipelineLayout(context.device, sdftPipelineLayout, 0); 
 	vkDestroyPipelineLayout(context.device, sumPipelineLayout, 0);
 
-	destroyChunk(chunk);
+	for (Chunk& chunk : chunks)
+		destroyChunk(chunk);
+	descriptorAllocator.free(trackDSet);
+	memoryPool.destroyBuffer(trackBuffer);
+
+	descriptorAllocator.free(twiddleDSet);
+	memoryPool.destroyBuffer(twiddleBuffer);
 
+	descriptorAllocator.destroy();
 	vkDestroyDescriptorSetLayout(context.device, sdftDescriptorSetLayout, 0);
 	vkDestroyCommandPool(context.device, transferCommandPool, 0);
+	memoryPool.destroy();
+}
+
+// Chunks go round-robin over the compute queues, the dedicated compute family first. A chunk keeps its queue,
+// so its stages stay in submission order while neighbouring chunks run on other queues
+void SDFTFilter::initQueues()
+{
+	std::vector<std::pair<int, int>> families = { { context.sdftFamilyIdx, context.sdftQueueCount } };
+	if (context.graphicsFamilyIdx != context.sdftFamilyIdx)
+		families.push_back({ context.graphicsFamilyIdx, context.graphicsQueueCount });
+	for (auto [familyIdx, queueCount] : families) {
+		for (int i = 0; i < queueCount; i++) {
+			ComputeQueue computeQueue = { .queue = VK_NULL_HANDLE, .familyIdx = familyIdx };
+			vkGetDeviceQueue(context.device, familyIdx, i, &computeQueue.queue);
+			computeQueues.push_back(computeQueue);
+		}
+	}
+	if (computeQueues.empty())
+		throw std::runtime_error("No compute queues to schedule the chunks on");
+
+	// Buffers written by the transfer queues and read by the compute ones are shared concurrently
+	bufferFamilies = { (uint32_t)context.transferFamilyIdx };
+	for (int i = 0; i < (int)chunks.size(); i++) {
+		const ComputeQueue& computeQueue = computeQueues[i % computeQueues.size()];
+		chunks[i].computeQueue = computeQueue.queue;
+		chunks[i].computeFamilyIdx = computeQueue.familyIdx;
+		if (std::find(bufferFamilies.begin(), bufferFamilies.end(), (uint32_t)computeQueue.familyIdx) == bufferFamilies.end())
+			bufferFamilies.push_back((uint32_t)computeQueue.familyIdx);
+	}
 }
 
 void SDFTFilter::initChunk(Chunk& chunk)
 {
 	// BUFFERS
-	VkDeviceSize tempSize = sizeof(glm::vec2) * props.spec_height * props.segment_width;
+	// Shared memory FFT does not need the stage ping-pong buffers
+	// STFT masking is sized for once the mode is first selected, see setProcessMode
+	bool isSTFT = processMode == PROCESS_STFT_MASK || stftFramePipeline != VK_NULL_HANDLE;
+	int tempColumns = props.segment_width * batchSize;
+	if (isSTFT) {
+		tempColumns = std::max(tempColumns, stft.frames);
+	}
+	if (props.fir_engine == FIR_OVERLAP_SAVE) {
+		tempColumns = std::max({ tempColumns, ols.segment_width * ols.partitions, ols.blocks + ols.partitions - 1, ols.blocks * ols.block_columns });
+	}
+	VkDeviceSize tempSize = sizeof(glm::vec2) * props.spec_height * tempColumns;
+	if (fft.isShared) tempSize = sizeof(glm::vec2);
 	createStorageBuffer(tempSize, chunk.sdftTemp1Buffer, chunk.sdftTemp1Binding);
 	createStorageBuffer(tempSize, chunk.sdftTemp2Buffer, chunk.sdftTemp2Binding);
 
 	VkDeviceSize size = sizeof(glm::vec2) * (props.spec_height + props.hop * props.segment_width);					// Chunk signal size
-	createStorageBuffer(size, chunk.signalRawBuffer, chunk.signalRawBinding);
-	createStorageBuffer(size + sizeof(glm::vec2) * props.spec_height, chunk.signalRawExtBuffer, chunk.signalRawExtBinding);
-	createStorageBuffer(size, chunk.signalFiltBuffer, chunk.signalFiltBinding);
-	chunk.uploadBuffer = createBuffer(context.device, context.physicalDevice, { (uint32_t)context.transferFamilyIdx }, 
-		size + sizeof(glm::vec2) * props.spec_height,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	chunk.bufferSignal = createBuffer(context.device, context.physicalDevice, { (uint32_t)context.transferFamilyIdx }, size,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-
-	createStorageBuffer(size * props.spec_height / SUMMATION_SIZE, chunk.filterTemp1Buffer, chunk.filterTemp1Binding);
-	createStorageBuffer(size * props.spec_height / SUMMATION_SIZE, chunk.filterTemp2Buffer, chunk.filterTemp2Binding);
+	createIOBuffer(size, chunk.signalRawBuffer, chunk.signalRawBinding);
+	// The overlap-save signal blocks read up to block_size past the extended signal, the tail stays zero
+	VkDeviceSize extPadding = props.fir_engine == FIR_OVERLAP_SAVE ? sizeof(glm::vec2) * ols.block_size : 0;
+	// Batched chunks follow each other hop * segment_width samples apart, sharing their overlaps
+	VkDeviceSize batchExtra = sizeof(glm::vec2) * props.hop * props.segment_width * (batchSize - 1);
+	createIOBuffer(size + sizeof(glm::vec2) * props.spec_height + std::max(extPadding, batchExtra), chunk.signalRawExtBuffer, chunk.signalRawExtBinding);
+	createIOBuffer(size, chunk.signalFiltBuffer, chunk.signalFiltBinding);
+	// Direct IO has the host work on the device buffers, the staging ones stay null
+	chunk.uploadBuffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	chunk.bufferSignal = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	chunk.bufferSpec = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	if (!isDirectIO) {
+		chunk.uploadBuffer = memoryPool.createBuffer({ (uint32_t)context.transferFamilyIdx },
+			size + sizeof(glm::vec2) * props.spec_height + batchExtra,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		chunk.bufferSignal = memoryPool.createBuffer({ (uint32_t)context.transferFamilyIdx }, size,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	}
+
+	VkDeviceSize filterTempSize = getFilterTempElementSize() * filterTileLen * props.spec_height / SUMMATION_SIZE;
+	createStorageBuffer(filterTempSize, chunk.filterTemp1Buffer, chunk.filterTemp1Binding);
+	createStorageBuffer(filterTempSize, chunk.filterTemp2Buffer, chunk.filterTemp2Binding);
 
 	VkDeviceSize specSize = sizeof(glm::vec2) * props.segment_width * props.spec_height;
-	createStorageBuffer(specSize, chunk.specRawBuffer, chunk.specRawBinding);
-	createStorageBuffer(specSize, chunk.specFiltBuffer, chunk.specFiltBinding);
+	// The real-input path keeps the packed half length transform in specRaw and the non-redundant bins in specFilt
+	// The filtered signal analysis writes full complex columns
+	VkDeviceSize specOutSize = std::max(getSpecBufferSize() * batchSize, specSize);
+	VkDeviceSize specRawSize = std::max(props.real_fft ? specSize / 2 * batchSize : specSize, specSize);
+	createStorageBuffer(specRawSize, chunk.specRawBuffer, chunk.specRawBinding);
+	createIOBuffer(specOutSize, chunk.specFiltBuffer, chunk.specFiltBinding);
 	createStorageBuffer(specSize, chunk.maskBuffer, chunk.maskBinding);
-	createStorageBuffer(specSize, chunk.filtersBuffer, chunk.filtersBinding);
-	chunk.bufferSpec = createBuffer(context.device, context.physicalDevice, { (uint32_t)context.transferFamilyIdx }, specSize,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	// The filters are real, the half precision plan stores the real parts only
+	createStorageBuffer(isHalfStorage ? sizeof(uint16_t) * props.segment_width * props.spec_height : specSize, chunk.filtersBuffer, chunk.filtersBinding);
+	if (!isDirectIO) {
+		chunk.bufferSpec = memoryPool.createBuffer({ (uint32_t)context.transferFamilyIdx }, specOutSize,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	}
+
+	if (props.fir_engine == FIR_OVERLAP_SAVE) {
+		VkDeviceSize columnSize = sizeof(glm::vec2) * props.spec_height;
+		VkDeviceSize filterPartsSize = columnSize * ols.segment_width * ols.partitions;
+		VkDeviceSize signalSpecSize = columnSize * std::max(ols.blocks + ols.partitions - 1, ols.blocks * ols.block_columns);
+		createStorageBuffer(filterPartsSize, chunk.olsFilterPartsBuffer, chunk.olsFilterPartsBinding);
+		createStorageBuffer(filterPartsSize, chunk.olsFilterSpecBuffer, chunk.olsFilterSpecBinding);
+		createStorageBuffer(signalSpecSize, chunk.olsSignalSpecBuffer, chunk.olsSignalSpecBinding);
+		createStorageBuffer(columnSize * ols.blocks * ols.block_columns, chunk.olsProductBuffer, chunk.olsProductBinding);
+	}
+
+	chunk.stftFramesBuffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	chunk.stftSpecBuffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	if (isSTFT) {
+		VkDeviceSize framesSize = sizeof(glm::vec2) * props.spec_height * stft.frames;
+		createStorageBuffer(framesSize, chunk.stftFramesBuffer, chunk.stftFramesBinding);
+		createStorageBuffer(framesSize, chunk.stftSpecBuffer, chunk.stftSpecBinding);
+	}
+
+	// Full filters until filter_window.comp measures them
+	VkDeviceSize windowSize = sizeof(FilterWindow) * props.segment_width;
+	createStorageBuffer(windowSize, chunk.filterWindowBuffer, chunk.filterWindowBinding, true);
+	FilterWindow* windows = (FilterWindow*)memoryPool.map(chunk.filterWindowBuffer.first);
+	for (int i = 0; i < props.segment_width; i++)
+		windows[i] = { .halfTaps = props.spec_height / 2, .error = 0 };
 
 	VkDeviceSize hostSpecSize = sizeof(glm::vec2) * props.hostMaskWidth * props.hostMaskHeight;
 	createStorageBuffer(hostSpecSize, chunk.maskHostBuffer, chunk.maskHostBinding, true);
 
+	// Staging memory stays mapped with its pool block, host coherent so nothing is flushed
+	chunk.maskHostMapped = (int*)memoryPool.map(chunk.maskHostBuffer.first);
+	if (isDirectIO) {
+		chunk.uploadMapped = memoryPool.map(chunk.signalRawExtBuffer.first);
+		chunk.rawMapped = (glm::vec2*)memoryPool.map(chunk.signalRawBuffer.first);
+		chunk.signalMapped = (glm::vec2*)memoryPool.map(chunk.signalFiltBuffer.first);
+		chunk.specMapped = memoryPool.map(chunk.specFiltBuffer.first);
+	}
+	else {
+		chunk.uploadMapped = memoryPool.map(chunk.uploadBuffer.first);
+		chunk.rawMapped = nullptr;
+		chunk.signalMapped = (glm::vec2*)memoryPool.map(chunk.bufferSignal.first);
+		chunk.specMapped = memoryPool.map(chunk.bufferSpec.first);
+	}
+
 	// DESCRIPTOR SETS
-	int pieceWidth = props.hop * props.segment_width + props.spec_height;
-	createDescriptorSet(context.device, { chunk.signalRawBinding },
-		chunk.srcDSet.first, & chunk.srcDSet.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.signalRawExtBinding },
-		chunk.srcDSetExt.first, & chunk.srcDSetExt.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.signalFiltBinding },
-		chunk.filteredDSet.first, & chunk.filteredDSet.second, &sdftDescriptorSetLayout);
-
-	createDescriptorSet(context.device, { chunk.sdftTemp1Binding },
-		chunk.temp1DSet.first, &chunk.temp1DSet.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.sdftTemp2Binding },
-		chunk.temp2DSet.first, &chunk.temp2DSet.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.filterTemp1Binding },
-		chunk.filterTemp1DSet.first, &chunk.filterTemp1DSet.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.filterTemp2Binding },
-		chunk.filterTemp2DSet.first, &chunk.filterTemp2DSet.second, &sdftDescriptorSetLayout);
-
-	createDescriptorSet(context.device, { chunk.specRawBinding },
-		chunk.dstSDFTDSet.first, & chunk.dstSDFTDSet.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.specFiltBinding },
-		chunk.dstSDFTFiltDSet.first, & chunk.dstSDFTFiltDSet.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.maskBinding },
-		chunk.maskDSet.first, & chunk.maskDSet.second, &sdftDescriptorSetLayout);
-	createDescriptorSet(context.device, { chunk.filtersBinding },
-		chunk.filterDSet.first, & chunk.filterDSet.second, &sdftDescriptorSetLayout);
-
-
-	createDescriptorSet(context.device, { chunk.maskHostBinding },
-		chunk.maskHostDSet.first, & chunk.maskHostDSet.second, &sdftDescriptorSetLayout);
+	chunk.srcDSet = descriptorAllocator.allocate({ chunk.signalRawBinding }, sdftDescriptorSetLayout);
+	chunk.srcDSetExt = descriptorAllocator.allocate({ chunk.signalRawExtBinding }, sdftDescriptorSetLayout);
+	chunk.filteredDSet = descriptorAllocator.allocate({ chunk.signalFiltBinding }, sdftDescriptorSetLayout);
+
+	chunk.temp1DSet = descriptorAllocator.allocate({ chunk.sdftTemp1Binding }, sdftDescriptorSetLayout);
+	chunk.temp2DSet = descriptorAllocator.allocate({ chunk.sdftTemp2Binding }, sdftDescriptorSetLayout);
+	chunk.filterTemp1DSet = descriptorAllocator.allocate({ chunk.filterTemp1Binding }, sdftDescriptorSetLayout);
+	chunk.filterTemp2DSet = descriptorAllocator.allocate({ chunk.filterTemp2Binding }, sdftDescriptorSetLayout);
+
+	chunk.dstSDFTDSet = descriptorAllocator.allocate({ chunk.specRawBinding }, sdftDescriptorSetLayout);
+	chunk.dstSDFTFiltDSet = descriptorAllocator.allocate({ chunk.specFiltBinding }, sdftDescriptorSetLayout);
+	chunk.maskDSet = descriptorAllocator.allocate({ chunk.maskBinding }, sdftDescriptorSetLayout);
+	chunk.filterDSet = descriptorAllocator.allocate({ chunk.filtersBinding }, sdftDescriptorSetLayout);
+	chunk.filterWindowDSet = descriptorAllocator.allocate({ chunk.filterWindowBinding }, sdftDescriptorSetLayout);
+	chunk.stftFramesDSet = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	chunk.stftSpecDSet = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	if (isSTFT) {
+		chunk.stftFramesDSet = descriptorAllocator.allocate({ chunk.stftFramesBinding }, sdftDescriptorSetLayout);
+		chunk.stftSpecDSet = descriptorAllocator.allocate({ chunk.stftSpecBinding }, sdftDescriptorSetLayout);
+	}
+
+
+	chunk.maskHostDSet = descriptorAllocator.allocate({ chunk.maskHostBinding }, sdftDescriptorSetLayout);
+
+	if (props.fir_engine == FIR_OVERLAP_SAVE) {
+		chunk.olsFilterPartsDSet = descriptorAllocator.allocate({ chunk.olsFilterPartsBinding }, sdftDescriptorSetLayout);
+		chunk.olsFilterSpecDSet = descriptorAllocator.allocate({ chunk.olsFilterSpecBinding }, sdftDescriptorSetLayout);
+		chunk.olsSignalSpecDSet = descriptorAllocator.allocate({ chunk.olsSignalSpecBinding }, sdftDescriptorSetLayout);
+		chunk.olsProductDSet = descriptorAllocator.allocate({ chunk.olsProductBinding }, sdftDescriptorSetLayout);
+	}
 
 	// Commands - SDFT
+	// The track copy is recorded again for every job
 	VkCommandPoolCreateInfo transferCommandPoolCI = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 		.pNext = 0,
-		.flags = 0,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
 		.queueFamilyIndex = (uint32_t)context.transferFamilyIdx
 	};
 	VkCommandPoolCreateInfo computeCommandPoolCI = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 		.pNext = 0,
 		.flags = 0,
-		.queueFamilyIndex = (uint32_t)context.sdftFamilyIdx
+		.queueFamilyIndex = (uint32_t)chunk.computeFamilyIdx
 	};
 	if (vkCreateCommandPool(context.device, &transferCommandPoolCI, 0, &chunk.cmdPoolTransfer) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create chunk transfer command pool");
@@ -130,19 +330,25 @@ void SDFTFilter::initChunk(Chunk& chunk)
 		.pNext = 0,
 		.commandPool = chunk.cmdPoolTransfer,
 		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 2
+		.commandBufferCount = 1
 	};
 	VkCommandBufferAllocateInfo computeCommandBufferAI = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.pNext = 0,
 		.commandPool = chunk.cmdPoolCompute,
 		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 4
+		.commandBufferCount = 1
 	};
 	if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffUploadSDFT) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create chunk SDFT upload command buffer");
 	if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffDowndloadSDFT) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create chunk SDFT download command buffer");
+	if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffUploadSignal) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create chunk signal upload command buffer");
+	if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffDownloadSignal) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create chunk signal download command buffer");
+	if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffTrackCopy) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create chunk track copy command buffer");
 	if (vkAllocateCommandBuffers(context.device, &computeCommandBufferAI, &chunk.cmdBuffProcessSDFT) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create chunk SDFT process command buffer");
 	if (vkAllocateCommandBuffers(context.device, &computeCommandBufferAI, &chunk.cmdBuffMaskRead) != VK_SUCCESS)
@@ -151,114 +357,168 @@ void SDFTFilter::initChunk(Chunk& chunk)
 		throw std::runtime_error("Cannot create chunk Filters creation command buffer");
 	if (vkAllocateCommandBuffers(context.device, &computeCommandBufferAI, &chunk.cmdBuffFilter) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create chunk Filters process command buffer");
+	if (vkAllocateCommandBuffers(context.device, &computeCommandBufferAI, &chunk.cmdBuffSTFT) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create chunk STFT masking command buffer");
+	if (vkAllocateCommandBuffers(context.device, &computeCommandBufferAI, &chunk.cmdBuffAnalyze) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create chunk analysis command buffer");
+	if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffDownloadAnalysis) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create chunk analysis download command buffer");
+	if (batchSize > 1) {
+		if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffUploadSpecBatch) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create chunk batched SDFT upload command buffer");
+		if (vkAllocateCommandBuffers(context.device, &transferCommandBufferAI, &chunk.cmdBuffDownloadSpecBatch) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create chunk batched SDFT download command buffer");
+		if (vkAllocateCommandBuffers(context.device, &computeCommandBufferAI, &chunk.cmdBuffProcessSpecBatch) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create chunk batched SDFT process command buffer");
+	}
 
+	VkSemaphoreTypeCreateInfo timelineCI = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.pNext = 0,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0
+	};
 	VkSemaphoreCreateInfo semaphoreCI = {
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-		.pNext = 0,
+		.pNext = &timelineCI,
 		.flags = 0
 	};
-	if (vkCreateSemaphore(context.device, &semaphoreCI, 0, &chunk.smphUploadedSDFT) != VK_SUCCESS)
-		throw std::runtime_error("Cannot create chunk SDFT Uploaded semaphore");
-	if (vkCreateSemaphore(context.device, &semaphoreCI, 0, &chunk.smphProcessedSDFT) != VK_SUCCESS)
-		throw std::runtime_error("Cannot create chunk SDFT Processed semaphore");
-	if (vkCreateSemaphore(context.device, &semaphoreCI, 0, &chunk.smphMaskRead) != VK_SUCCESS)
-		throw std::runtime_error("Cannot create chunk Mask Read semaphore");
-	if (vkCreateSemaphore(context.device, &semaphoreCI, 0, &chunk.smphFiltersRdy) != VK_SUCCESS)
-		throw std::runtime_error("Cannot create chunk Filters ready semaphore");
-
-	VkFenceCreateInfo fenceCI = {
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	if (vkCreateSemaphore(context.device, &semaphoreCI, 0, &chunk.timeline) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create chunk timeline semaphore");
+	for (int stage = 0; stage < STAGE_COUNT; stage++)
+		chunk.stageValues[stage] = stage;
+	chunk.ticket = 0;
+}
+
+// Batched chunks share one dispatch per stage, the z of the grid picks the chunk
+void SDFTFilter::recordSpectrogram(Chunk& chunk, VkCommandBuffer upload, VkCommandBuffer process, VkCommandBuffer download, int batch)
+{
+	int chunkStride = props.hop * props.segment_width;
+	VkDeviceSize size = sizeof(glm::vec2) * (props.spec_height + chunkStride * batch);
+	VkDeviceSize specSize = getSpecBufferSize() * batch;
+	// Real samples are uploaded packed, two per complex element
+	if (props.real_fft) {
+		size /= 2;
+		chunkStride /= 2;
+	}
+	VkCommandBufferBeginInfo bufferBI = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		.pNext = 0,
-		.flags = 0 //VK_FENCE_CREATE_SIGNALED_BIT
+		.flags = 0,
+		.pInheritanceInfo = 0
 	};
-	if (vkCreateFence(context.device, &fenceCI, 0, &chunk.fenceSDFT) != VK_SUCCESS)
-		throw std::runtime_error("Cannot create chunk SDFT Processed fence");
-	if (vkCreateFence(context.device, &fenceCI, 0, &chunk.fenceFilter) != VK_SUCCESS)
-		throw std::runtime_error("Cannot create chunk SDFT Processed fence");
+
+	if (!isDirectIO) {
+		vkBeginCommandBuffer(upload, &bufferBI);
+		VkBufferCopy bufferCopyRegion = {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = size
+		};
+		vkCmdCopyBuffer(upload, chunk.uploadBuffer.first, chunk.signalRawExtBuffer.first, 1, &bufferCopyRegion);
+		vkEndCommandBuffer(upload);
+
+		vkBeginCommandBuffer(download, &bufferBI);
+		VkBufferCopy specBufferCopyRegion = {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = specSize
+		};
+		vkCmdCopyBuffer(download, chunk.specFiltBuffer.first, chunk.bufferSpec.first, 1, &specBufferCopyRegion);
+		vkEndCommandBuffer(download);
+	}
+
+	if (vkBeginCommandBuffer(process, &bufferBI) != VK_SUCCESS)
+		throw std::runtime_error("Cannot begin SDFT Process buffer");
+	if (isRecursiveSDFT) {
+		recordSlidingSDFT(process, chunk, batch);
+	}
+	else if (props.real_fft) {
+		recordSDFT(process, realFFT, chunk.srcDSetExt.first, chunk.dstSDFTDSet.first, chunk, chunk.signalRawExtBuffer.first, chunk.specRawBuffer.first, false, false,
+			0, 0, batch, chunkStride);
+		recordRealSplit(process, chunk.dstSDFTDSet.first, chunk.dstSDFTFiltDSet.first, chunk.specRawBuffer.first, 0, batch);
+	}
+	else {
+		recordSDFT(process, fft, chunk.srcDSetExt.first, chunk.dstSDFTFiltDSet.first, chunk, chunk.signalRawExtBuffer.first, chunk.specFiltBuffer.first, false, true,
+			0, 0, batch, chunkStride);
+	}
+	recordHostBarrier(process);
+	if (vkEndCommandBuffer(process) != VK_SUCCESS)
+		throw std::runtime_error("Cannot begin command buffer");
 }
 
 void SDFTFilter::recordChunk(Chunk& chunk)
 {
-	VkDeviceSize size = sizeof(glm::vec2) * (props.spec_height + props.hop * props.segment_width);
-	VkDeviceSize specSize = sizeof(glm::vec2) * props.segment_width * props.spec_height;
-	// TODO: Make one BufferBI?
-	VkCommandBufferBeginInfo transferBufferBI = {
+	// Transfer and compute buffers are all recorded once and resubmitted
+	VkCommandBufferBeginInfo bufferBI = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		.pNext = 0,
 		.flags = 0,
 		.pInheritanceInfo = 0
 	};
-	VkCommandBufferBeginInfo sdftBufferBI = {
-	.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-	.pNext = 0,
-	.flags = 0,
-	.pInheritanceInfo = 0
-	};
 
-	vkBeginCommandBuffer(chunk.cmdBuffUploadSDFT, &transferBufferBI);
-	VkBufferCopy bufferCopyRegion = {
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = size
-	};
-	vkCmdCopyBuffer(chunk.cmdBuffUploadSDFT, chunk.uploadBuffer.first, chunk.signalRawExtBuffer.first, 1, &bufferCopyRegion);
-	vkEndCommandBuffer(chunk.cmdBuffUploadSDFT);
+	recordSpectrogram(chunk, chunk.cmdBuffUploadSDFT, chunk.cmdBuffProcessSDFT, chunk.cmdBuffDowndloadSDFT, 1);
+	if (batchSize > 1)
+		recordSpectrogram(chunk, chunk.cmdBuffUploadSpecBatch, chunk.cmdBuffProcessSpecBatch, chunk.cmdBuffDownloadSpecBatch, batchSize);
 
-	vkBeginCommandBuffer(chunk.cmdBuffDowndloadSDFT, &transferBufferBI);
-	VkBufferCopy specBufferCopyRegion = {
+	// Filtering takes the padded signal as complex samples, the raw copy skips spec_height/2 from both sides
+	VkDeviceSize signalSize = sizeof(glm::vec2) * (props.spec_height + props.hop * props.segment_width);
+	VkBufferCopy signalCopyRegion = {
 		.srcOffset = 0,
 		.dstOffset = 0,
-		.size = specSize
+		.size = signalSize + sizeof(glm::vec2) * props.spec_height
 	};
-	vkCmdCopyBuffer(chunk.cmdBuffDowndloadSDFT, chunk.specFiltBuffer.first, chunk.bufferSpec.first, 1, &specBufferCopyRegion);
-	vkEndCommandBuffer(chunk.cmdBuffDowndloadSDFT);
-
-	if (vkBeginCommandBuffer(chunk.cmdBuffProcessSDFT, &sdftBufferBI) != VK_SUCCESS)
-		throw std::runtime_error("Cannot begin SDFT Process buffer");
-	vkCmdBindPipeline(chunk.cmdBuffProcessSDFT, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipeline);
-
-	recordSDFT(chunk.cmdBuffProcessSDFT, chunk.srcDSetExt.first, chunk.dstSDFTFiltDSet.first, chunk, chunk.signalRawExtBuffer.first, chunk.specFiltBuffer.first, false, true);
+	if (!isDirectIO) {
+		vkBeginCommandBuffer(chunk.cmdBuffUploadSignal, &bufferBI);
+		vkCmdCopyBuffer(chunk.cmdBuffUploadSignal, chunk.uploadBuffer.first, chunk.signalRawExtBuffer.first, 1, &signalCopyRegion);
+		signalCopyRegion.srcOffset = sizeof(glm::vec2) * (props.spec_height / 2);
+		signalCopyRegion.size = signalSize;
+		vkCmdCopyBuffer(chunk.cmdBuffUploadSignal, chunk.uploadBuffer.first, chunk.signalRawBuffer.first, 1, &signalCopyRegion);
+		vkEndCommandBuffer(chunk.cmdBuffUploadSignal);
+
+		vkBeginCommandBuffer(chunk.cmdBuffDownloadSignal, &bufferBI);
+		signalCopyRegion.srcOffset = 0;
+		vkCmdCopyBuffer(chunk.cmdBuffDownloadSignal, chunk.signalFiltBuffer.first, chunk.bufferSignal.first, 1, &signalCopyRegion);
+		vkEndCommandBuffer(chunk.cmdBuffDownloadSignal);
+	}
 
-	if (vkEndCommandBuffer(chunk.cmdBuffProcessSDFT) != VK_SUCCESS)
-		throw std::runtime_error("Cannot begin command buffer");
+	// The filtered samples are complex with zero imaginary parts, so the analysis takes the complex plan
+	// and reads them from signalFilt the way calcSDFT reads its padded input
+	if (vkBeginCommandBuffer(chunk.cmdBuffAnalyze, &bufferBI) != VK_SUCCESS)
+		throw std::runtime_error("Cannot begin analysis buffer");
+	recordSDFT(chunk.cmdBuffAnalyze, fft, chunk.filteredDSet.first, chunk.dstSDFTFiltDSet.first, chunk, chunk.signalFiltBuffer.first, chunk.specFiltBuffer.first, false, true);
+	recordHostBarrier(chunk.cmdBuffAnalyze);
+	if (vkEndCommandBuffer(chunk.cmdBuffAnalyze) != VK_SUCCESS)
+		throw std::runtime_error("Cannot end analysis buffer");
+
+	if (!isDirectIO) {
+		vkBeginCommandBuffer(chunk.cmdBuffDownloadAnalysis, &bufferBI);
+		vkCmdCopyBuffer(chunk.cmdBuffDownloadAnalysis, chunk.signalFiltBuffer.first, chunk.bufferSignal.first, 1, &signalCopyRegion);
+		VkBufferCopy analysisCopyRegion = {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = sizeof(glm::vec2) * props.segment_width * props.spec_height
+		};
+		vkCmdCopyBuffer(chunk.cmdBuffDownloadAnalysis, chunk.specFiltBuffer.first, chunk.bufferSpec.first, 1, &analysisCopyRegion);
+		vkEndCommandBuffer(chunk.cmdBuffDownloadAnalysis);
+	}
 
 	chunk.waitStagesCompute = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	chunk.waitStagesTransfer = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	chunk.submitInfoSDFTUpload = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = 0,
-		.waitSemaphoreCount = 0,
-		.pWaitSemaphores = 0,
-		.pWaitDstStageMask = 0,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &chunk.cmdBuffUploadSDFT,
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &chunk.smphUploadedSDFT
-	};
-
-	chunk.submitInfoSDFTDownload = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = 0,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &chunk.smphProcessedSDFT,
-		.pWaitDstStageMask = &chunk.waitStagesTransfer,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &chunk.cmdBuffDowndloadSDFT,
-		.signalSemaphoreCount = 0,
-		.pSignalSemaphores = 0
-	};
-
-	chunk.submitInfoSDFTProcess = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = 0,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &chunk.smphUploadedSDFT,
-		.pWaitDstStageMask = &chunk.waitStagesCompute,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &chunk.cmdBuffProcessSDFT,
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &chunk.smphProcessedSDFT
-	};
+	chunk.submitInfoSDFTUpload = createTimelineSubmit(chunk, &chunk.cmdBuffUploadSDFT, chunk.timelineSDFTUpload,
+		0, 0, STAGE_UPLOADED);
+	chunk.submitInfoSDFTProcess = createTimelineSubmit(chunk, &chunk.cmdBuffProcessSDFT, chunk.timelineSDFTProcess,
+		&chunk.waitStagesCompute, STAGE_UPLOADED, STAGE_SPEC_PROCESSED);
+	chunk.submitInfoSDFTDownload = createTimelineSubmit(chunk, &chunk.cmdBuffDowndloadSDFT, chunk.timelineSDFTDownload,
+		&chunk.waitStagesTransfer, STAGE_SPEC_PROCESSED, STAGE_SPEC_DOWNLOADED);
+	if (batchSize > 1) {
+		chunk.submitInfoSpecBatchUpload = createTimelineSubmit(chunk, &chunk.cmdBuffUploadSpecBatch, chunk.timelineSpecBatchUpload,
+			0, 0, STAGE_UPLOADED);
+		chunk.submitInfoSpecBatchProcess = createTimelineSubmit(chunk, &chunk.cmdBuffProcessSpecBatch, chunk.timelineSpecBatchProcess,
+			&chunk.waitStagesCompute, STAGE_UPLOADED, STAGE_SPEC_PROCESSED);
+		chunk.submitInfoSpecBatchDownload = createTimelineSubmit(chunk, &chunk.cmdBuffDownloadSpecBatch, chunk.timelineSpecBatchDownload,
+			&chunk.waitStagesTransfer, STAGE_SPEC_PROCESSED, STAGE_SPEC_DOWNLOADED);
+	}
 
 	// FILTERING
 	FIRState state = {
@@ -266,88 +526,75 @@ void SDFTFilter::recordChunk(Chunk& chunk)
 		.hop = props.hop,
 		.spec_height = props.spec_height
 	};
-	SUMState sumState = {
-		.stride = props.spec_height / SUMMATION_SIZE,
-		.out_stride = props.spec_height / SUMMATION_SIZE,
-		.spec_height = props.spec_height / SUMMATION_SIZE,
-		.signal_len = props.spec_height + props.hop * props.segment_width
-	};
-	VkBufferMemoryBarrier filterBarrier = {
-		   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-		   .pNext = 0,
-		   .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
-		   .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-		   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		   .offset = 0,
-		   .size = VK_WHOLE_SIZE
-	};
-	// chunk.filterDSet.first, chunk.srcDSetExt.first, chunk.filteredDSet.first
-	int nStages = (int)log2(props.spec_height / SUMMATION_SIZE);
-	std::vector< VkDescriptorSet> descriptorsSrcTemp1 = { chunk.filterDSet.first, chunk.srcDSetExt.first, chunk.filterTemp1DSet.first };
-	std::vector< VkDescriptorSet> descriptorsTemp1Temp2 = { chunk.filterTemp1DSet.first, chunk.filterTemp2DSet.first };
-	std::vector< VkDescriptorSet> descriptorsTemp2Temp1 = { chunk.filterTemp2DSet.first, chunk.filterTemp1DSet.first };
-	std::vector< VkDescriptorSet> descriptorsTemp1Dst = { chunk.filterTemp1DSet.first, chunk.filteredDSet.first };
-	std::vector< VkDescriptorSet> descriptorsTemp2Dst = { chunk.filterTemp2DSet.first, chunk.filteredDSet.first };
 	//std::vector< VkDescriptorSet> descriptors = { chunk.filterDSet.first, src, dst };
-	if (vkBeginCommandBuffer(chunk.cmdBuffFilter, &sdftBufferBI) != VK_SUCCESS)
+	if (vkBeginCommandBuffer(chunk.cmdBuffFilter, &bufferBI) != VK_SUCCESS)
 		throw std::runtime_error("Cannot begin command buffer");
-	vkCmdBindPipeline(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipeline);
-	vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipelineLayout, 0, (uint32_t)descriptorsSrcTemp1.size(), descriptorsSrcTemp1.data(), 0, 0);
-	vkCmdPushConstants(chunk.cmdBuffFilter, filterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FIRState), &state);
-	vkCmdDispatch(chunk.cmdBuffFilter, std::max(props.spec_height / SUMMATION_SIZE, 1), std::max(state.signal_len / SUMMATION_WIDTH, 1), 1);
-	filterBarrier.buffer = chunk.filterTemp1Buffer.first;
-	vkCmdPipelineBarrier(chunk.cmdBuffFilter, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &filterBarrier, 0, nullptr);
-
-	// Sum the multiplications
-	vkCmdBindPipeline(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipeline);
-	for (int stage = 0; stage < nStages - 1; stage++) {
-		sumState.stride = sumState.stride / 2;
-		if (stage % 2 == 0) {
-			vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp1Temp2.size(), descriptorsTemp1Temp2.data(), 0, 0);
-		}
-		else {
-			vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp2Temp1.size(), descriptorsTemp2Temp1.data(), 0, 0);
-		}
-		vkCmdPushConstants(chunk.cmdBuffFilter, sumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SUMState), &sumState);
-		vkCmdDispatch(chunk.cmdBuffFilter, std::max(sumState.stride / SUMMATION_SIZE, 1), std::max(state.signal_len / SUMMATION_WIDTH, 1), 1);
-		vkCmdPipelineBarrier(chunk.cmdBuffFilter, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-			VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &filterBarrier, 0, nullptr);
-		if (stage % 2 == 0) {
-			filterBarrier.buffer = chunk.filterTemp2Buffer.first;
-		}
-		else {
-			filterBarrier.buffer = chunk.filterTemp1Buffer.first;
-		}
-		vkCmdPipelineBarrier(chunk.cmdBuffFilter, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-			VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &filterBarrier, 0, nullptr);
+	if (props.fir_engine == FIR_OVERLAP_SAVE) {
+		recordOverlapSave(chunk.cmdBuffFilter, chunk);
 	}
-	if (nStages % 2 == 0) {
-		vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp2Dst.size(), descriptorsTemp2Dst.data(), 0, 0);
+	else if (props.fir_engine == FIR_TILED) {
+		// 512 output samples per workgroup, written straight into signalFilt
+		std::vector< VkDescriptorSet> descriptorsSrcDst = { chunk.filterDSet.first, chunk.srcDSetExt.first, chunk.filteredDSet.first, chunk.filterWindowDSet.first };
+		vkCmdBindPipeline(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterTiledPipeline);
+		vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipelineLayout, 0, (uint32_t)descriptorsSrcDst.size(), descriptorsSrcDst.data(), 0, 0);
+		vkCmdPushConstants(chunk.cmdBuffFilter, filterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FIRState), &state);
+		vkCmdDispatch(chunk.cmdBuffFilter, (state.signal_len + 511) / 512, 1, 1);
+	}
+	else if (isSubgroupReduce) {
+		// Whole tap window reduced in one dispatch, 8 output samples per workgroup
+		std::vector< VkDescriptorSet> descriptorsSrcDst = { chunk.filterDSet.first, chunk.srcDSetExt.first, chunk.filteredDSet.first, chunk.filterWindowDSet.first };
+		vkCmdBindPipeline(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterSubgroupPipeline);
+		vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipelineLayout, 0, (uint32_t)descriptorsSrcDst.size(), descriptorsSrcDst.data(), 0, 0);
+		vkCmdPushConstants(chunk.cmdBuffFilter, filterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FIRState), &state);
+		vkCmdDispatch(chunk.cmdBuffFilter, (state.signal_len + 7) / 8, 1, 1);
 	}
 	else {
-		vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp1Dst.size(), descriptorsTemp1Dst.data(), 0, 0);
+		// The scratch holds one tile, each tile's reduction ends before the next tile's products overwrite it
+		int rows = std::max(state.signal_len / SUMMATION_WIDTH, 1) * SUMMATION_WIDTH;
+		for (int offset = 0; offset < rows; offset += filterTileLen)
+			recordFilterTile(chunk, offset, std::min(filterTileLen, rows - offset));
 	}
-	sumState.stride = sumState.stride / 2; // Stride should be 1 here
-	sumState.out_stride = 1;
-	vkCmdPushConstants(chunk.cmdBuffFilter, sumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SUMState), &sumState);
-	vkCmdDispatch(chunk.cmdBuffFilter, 1, std::max(state.signal_len / SUMMATION_WIDTH, 1), 1);
+	recordHostBarrier(chunk.cmdBuffFilter);
 	if (vkEndCommandBuffer(chunk.cmdBuffFilter) != VK_SUCCESS)
 		throw std::runtime_error("Cannot begin command buffer");
 
 
-	if (vkBeginCommandBuffer(chunk.cmdBuffMaskSDFT, &sdftBufferBI) != VK_SUCCESS)
+	if (vkBeginCommandBuffer(chunk.cmdBuffMaskSDFT, &bufferBI) != VK_SUCCESS)
 		throw std::runtime_error("Cannot begin SDFT Process buffer");
-	vkCmdBindPipeline(chunk.cmdBuffMaskSDFT, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipeline);
-
-	recordSDFT(chunk.cmdBuffMaskSDFT, chunk.maskDSet.first, chunk.filterDSet.first, chunk, chunk.maskBuffer.first, chunk.specRawBuffer.first, true, true);
+	recordSDFT(chunk.cmdBuffMaskSDFT, isHalfStorage ? filterFFT : fft, chunk.maskDSet.first, chunk.filterDSet.first, chunk, chunk.maskBuffer.first, chunk.specRawBuffer.first, true, true);
+	if (props.filter_tolerance > 0) {
+		// Measure the impulse responses right after they are built
+		WindowState windowState = {
+			.spec_height = props.spec_height,
+			.tolerance = props.filter_tolerance
+		};
+		VkBufferMemoryBarrier windowBarrier = {
+			   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			   .pNext = 0,
+			   .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+			   .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .buffer = chunk.filtersBuffer.first,
+			   .offset = 0,
+			   .size = VK_WHOLE_SIZE
+		};
+		std::vector< VkDescriptorSet> windowIO = { chunk.filterDSet.first, chunk.filterWindowDSet.first };
+		vkCmdBindPipeline(chunk.cmdBuffMaskSDFT, VK_PIPELINE_BIND_POINT_COMPUTE, filterWindowPipeline);
+		vkCmdBindDescriptorSets(chunk.cmdBuffMaskSDFT, VK_PIPELINE_BIND_POINT_COMPUTE, windowPipelineLayout, 0, (uint32_t)windowIO.size(), windowIO.data(), 0, 0);
+		vkCmdPipelineBarrier(chunk.cmdBuffMaskSDFT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &windowBarrier, 0, nullptr);
+		vkCmdPushConstants(chunk.cmdBuffMaskSDFT, windowPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(WindowState), &windowState);
+		vkCmdDispatch(chunk.cmdBuffMaskSDFT, 1, props.segment_width, 1);
+		// collectChunk reads the windows through their mapping whatever the IO placement
+		recordHostBarrier(chunk.cmdBuffMaskSDFT, true);
+	}
 
 	if (vkEndCommandBuffer(chunk.cmdBuffMaskSDFT) != VK_SUCCESS)
 		throw std::runtime_error("Cannot begin command buffer");
 
 	// Run read-resize queue
-	vkBeginCommandBuffer(chunk.cmdBuffMaskRead, &transferBufferBI);
+	vkBeginCommandBuffer(chunk.cmdBuffMaskRead, &bufferBI);
 
 	LinearResize resize = {
 		.src_rows = props.hostMaskHeight,
@@ -364,296 +611,630 @@ void SDFTFilter::recordChunk(Chunk& chunk)
 
 	vkEndCommandBuffer(chunk.cmdBuffMaskRead);
 
-	chunk.submitInfoMaskRead = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = 0,
-		.waitSemaphoreCount = 0,
-		.pWaitSemaphores = 0,
-		.pWaitDstStageMask = 0,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &chunk.cmdBuffMaskRead,
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &chunk.smphMaskRead
-	};
-
-	chunk.submitInfoFilter = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = 0,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &chunk.smphFiltersRdy,
-		.pWaitDstStageMask = &chunk.waitStagesCompute,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &chunk.cmdBuffFilter,
-		.signalSemaphoreCount = 0,
-		.pSignalSemaphores = 0
-	};
-
-	chunk.submitInfoMaskSDFT = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = 0,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &chunk.smphMaskRead,
-		.pWaitDstStageMask = &chunk.waitStagesCompute,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &chunk.cmdBuffMaskSDFT,
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &chunk.smphFiltersRdy
-	};
+	// The mask read waits for the upload too, so the stages signal the timeline in increasing order
+	chunk.submitInfoSignalUpload = createTimelineSubmit(chunk, &chunk.cmdBuffUploadSignal, chunk.timelineSignalUpload,
+		0, 0, STAGE_UPLOADED);
+	chunk.submitInfoTrackCopy = createTimelineSubmit(chunk, &chunk.cmdBuffTrackCopy, chunk.timelineTrackCopy,
+		0, 0, STAGE_UPLOADED);
+	chunk.submitInfoMaskRead = createTimelineSubmit(chunk, &chunk.cmdBuffMaskRead, chunk.timelineMaskRead,
+		&chunk.waitStagesCompute, STAGE_UPLOADED, STAGE_MASK_READ);
+	chunk.submitInfoMaskSDFT = createTimelineSubmit(chunk, &chunk.cmdBuffMaskSDFT, chunk.timelineMaskSDFT,
+		&chunk.waitStagesCompute, STAGE_MASK_READ, STAGE_FILTERS_READY);
+	chunk.submitInfoFilter = createTimelineSubmit(chunk, &chunk.cmdBuffFilter, chunk.timelineFilter,
+		&chunk.waitStagesCompute, STAGE_FILTERS_READY, STAGE_FILTERED);
+	chunk.submitInfoSignalDownload = createTimelineSubmit(chunk, &chunk.cmdBuffDownloadSignal, chunk.timelineSignalDownload,
+		&chunk.waitStagesTransfer, STAGE_FILTERED, STAGE_DOWNLOADED);
+	chunk.submitInfoAnalyze = createTimelineSubmit(chunk, &chunk.cmdBuffAnalyze, chunk.timelineAnalyze,
+		&chunk.waitStagesCompute, STAGE_FILTERED, STAGE_ANALYZED);
+	chunk.submitInfoAnalysisDownload = createTimelineSubmit(chunk, &chunk.cmdBuffDownloadAnalysis, chunk.timelineAnalysisDownload,
+		&chunk.waitStagesTransfer, STAGE_ANALYZED, STAGE_ANALYSIS_DOWNLOADED);
+
+	// STFT masking needs the resized mask only, recorded once the mode is first selected
+	if (stftFramePipeline != VK_NULL_HANDLE)
+		recordSTFTChunk(chunk);
+	chunk.submitInfoSTFT = createTimelineSubmit(chunk, &chunk.cmdBuffSTFT, chunk.timelineSTFT,
+		&chunk.waitStagesCompute, STAGE_MASK_READ, STAGE_FILTERED);
 }
 
 void SDFTFilter::destroyChunk(Chunk& chunk)
 {
-	vkDestroyFence(context.device, chunk.fenceFilter, 0);
-	vkDestroySemaphore(context.device, chunk.smphMaskRead, 0);
-	vkDestroySemaphore(context.device, chunk.smphFiltersRdy, 0);
-
-	vkDestroyFence(context.device, chunk.fenceSDFT, 0);
-	vkDestroySemaphore(context.device, chunk.smphProcessedSDFT, 0);
-	vkDestroySemaphore(context.device, chunk.smphUploadedSDFT, 0);
+	vkDestroySemaphore(context.device, chunk.timeline, 0);
 	vkDestroyCommandPool(context.device, chunk.cmdPoolCompute, 0);
 	vkDestroyCommandPool(context.device, chunk.cmdPoolTransfer, 0);
 
-	vkDestroyDescriptorPool(context.device, chunk.maskHostDSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.filterDSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.maskDSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.dstSDFTFiltDSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.dstSDFTDSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.temp2DSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.temp1DSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.filteredDSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.srcDSetExt.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.srcDSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.filterTemp1DSet.second, 0);
-	vkDestroyDescriptorPool(context.device, chunk.filterTemp2DSet.second, 0);
-
-	vkFreeMemory(context.device, chunk.maskHostBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.maskHostBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.filtersBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.filtersBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.maskBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.maskBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.specFiltBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.specFiltBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.specRawBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.specRawBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.signalFiltBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.signalFiltBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.signalRawBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.signalRawBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.signalRawExtBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.signalRawExtBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.sdftTemp2Buffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.sdftTemp2Buffer.first, 0);
-	vkFreeMemory(context.device, chunk.sdftTemp1Buffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.sdftTemp1Buffer.first, 0);
-	vkFreeMemory(context.device, chunk.filterTemp2Buffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.filterTemp2Buffer.first, 0);
-	vkFreeMemory(context.device, chunk.filterTemp1Buffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.filterTemp1Buffer.first, 0);
-
-	vkDestroyBuffer(context.device, chunk.uploadBuffer.first, 0);
-	vkFreeMemory(context.device, chunk.uploadBuffer.second, 0);
-	vkDestroyBuffer(context.device, chunk.bufferSignal.first, 0);
-	vkFreeMemory(context.device, chunk.bufferSignal.second, 0);
-	vkDestroyBuffer(context.device, chunk.bufferSpec.first, 0);
-	vkFreeMemory(context.device, chunk.bufferSpec.second, 0);
-}
-
-void SDFTFilter::update(Chunk& chunk, int* data)
+	descriptorAllocator.free(chunk.maskHostDSet);
+	descriptorAllocator.free(chunk.filterDSet);
+	descriptorAllocator.free(chunk.filterWindowDSet);
+	descriptorAllocator.free(chunk.stftFramesDSet);
+	descriptorAllocator.free(chunk.stftSpecDSet);
+	descriptorAllocator.free(chunk.maskDSet);
+	descriptorAllocator.free(chunk.dstSDFTFiltDSet);
+	descriptorAllocator.free(chunk.dstSDFTDSet);
+	descriptorAllocator.free(chunk.temp2DSet);
+	descriptorAllocator.free(chunk.temp1DSet);
+	descriptorAllocator.free(chunk.filteredDSet);
+	descriptorAllocator.free(chunk.srcDSetExt);
+	descriptorAllocator.free(chunk.srcDSet);
+	descriptorAllocator.free(chunk.filterTemp1DSet);
+	descriptorAllocator.free(chunk.filterTemp2DSet);
+	if (props.fir_engine == FIR_OVERLAP_SAVE) {
+		descriptorAllocator.free(chunk.olsFilterPartsDSet);
+		descriptorAllocator.free(chunk.olsFilterSpecDSet);
+		descriptorAllocator.free(chunk.olsSignalSpecDSet);
+		descriptorAllocator.free(chunk.olsProductDSet);
+		memoryPool.destroyBuffer(chunk.olsFilterPartsBuffer);
+		memoryPool.destroyBuffer(chunk.olsFilterSpecBuffer);
+		memoryPool.destroyBuffer(chunk.olsSignalSpecBuffer);
+		memoryPool.destroyBuffer(chunk.olsProductBuffer);
+	}
+
+	memoryPool.destroyBuffer(chunk.maskHostBuffer);
+	memoryPool.destroyBuffer(chunk.filtersBuffer);
+	memoryPool.destroyBuffer(chunk.filterWindowBuffer);
+	memoryPool.destroyBuffer(chunk.stftFramesBuffer);
+	memoryPool.destroyBuffer(chunk.stftSpecBuffer);
+	memoryPool.destroyBuffer(chunk.maskBuffer);
+	memoryPool.destroyBuffer(chunk.specFiltBuffer);
+	memoryPool.destroyBuffer(chunk.specRawBuffer);
+	memoryPool.destroyBuffer(chunk.signalFiltBuffer);
+	memoryPool.destroyBuffer(chunk.signalRawBuffer);
+	memoryPool.destroyBuffer(chunk.signalRawExtBuffer);
+	memoryPool.destroyBuffer(chunk.sdftTemp2Buffer);
+	memoryPool.destroyBuffer(chunk.sdftTemp1Buffer);
+	memoryPool.destroyBuffer(chunk.filterTemp2Buffer);
+	memoryPool.destroyBuffer(chunk.filterTemp1Buffer);
+
+	memoryPool.destroyBuffer(chunk.uploadBuffer);
+	memoryPool.destroyBuffer(chunk.bufferSignal);
+	memoryPool.destroyBuffer(chunk.bufferSpec);
+}
+
+void SDFTFilter::submitChunk(Chunk& chunk, int* mask, const std::vector<float>& signalIn, bool isAnalyze)
 {
 #ifdef PROFILING
 	auto start = std::chrono::high_resolution_clock::now();
-	std::cout << std::endl << "Processing. ";
 #endif
-	// READ AND RESIZE THE MASK
-	void* memptr;
-	uint32_t size = props.hostMaskHeight * props.segment_width * sizeof(int);
-	vkMapMemory(context.device, chunk.maskHostBuffer.second, 0, size, 0, &memptr);
-	memcpy(memptr, data, size);
-	vkUnmapMemory(context.device, chunk.maskHostBuffer.second);
+	startJob(chunk);
+	stageMask(chunk, mask);
+
+	// The signalIn must include spectrogram_height / 2 items from both sides, a shorter one is zero padded
+	int signalLen = props.hop * props.segment_width + 2 * props.spec_height;
+	if ((int)signalIn.size() > signalLen)
+		throw std::runtime_error("Chunk signal is longer than hop * segment_width + 2 * spec_height");
+	glm::vec2* samples = (glm::vec2*)chunk.uploadMapped;
+	for (int i = 0; i < signalLen; i++) {
+		samples[i] = glm::vec2(i < (int)signalIn.size() ? signalIn[i] : 0.0f, 0.0f);
+	}
 #ifdef PROFILING
 	auto end = std::chrono::high_resolution_clock::now();
 	float time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 	std::cout << "to mapped: " << time_ms << ' ';
-	start = std::chrono::high_resolution_clock::now();
 #endif
+	submitFiltering(chunk, isDirectIO ? nullptr : &chunk.submitInfoSignalUpload, isAnalyze);
+}
 
-	if (vkQueueSubmit(rawSDFTQueue, 1, &chunk.submitInfoMaskRead, VK_NULL_HANDLE) != VK_SUCCESS)
-		throw std::runtime_error("Cannot submit to filtering queue");
-	if (vkQueueSubmit(rawSDFTQueue, 1, &chunk.submitInfoMaskSDFT, VK_NULL_HANDLE) != VK_SUCCESS)
-		throw std::runtime_error("Cannot submit to filtering queue");
+// Chunk index of the loaded track is read by copies recorded for this job, nothing crosses the bus
+void SDFTFilter::submitTrackChunk(Chunk& chunk, int* mask, int index, bool isAnalyze)
+{
+	if (index < 0 || index >= trackChunks)
+		throw std::runtime_error("Chunk is outside the loaded signal");
+	startJob(chunk);
+	stageMask(chunk, mask);
 
-	if (vkQueueSubmit(rawSDFTQueue, 1, &chunk.submitInfoFilter, chunk.fenceFilter) != VK_SUCCESS)
-		throw std::runtime_error("Cannot submit to filtering queue");
-	vkWaitForFences(context.device, 1, &chunk.fenceFilter, VK_TRUE, (uint64_t)-1);
-	vkResetFences(context.device, 1, &chunk.fenceFilter);
+	// The copy buffer is idle, its chunk was collected before taking the job
+	VkCommandBufferBeginInfo copyBI = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = 0,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = 0
+	};
+	VkDeviceSize signalSize = sizeof(glm::vec2) * (props.spec_height + props.hop * props.segment_width);
+	VkDeviceSize first = signalSize * index;
+	vkBeginCommandBuffer(chunk.cmdBuffTrackCopy, &copyBI);
+	VkBufferCopy signalCopyRegion = {
+		.srcOffset = first,
+		.dstOffset = 0,
+		.size = signalSize + sizeof(glm::vec2) * props.spec_height
+	};
+	vkCmdCopyBuffer(chunk.cmdBuffTrackCopy, trackBuffer.first, chunk.signalRawExtBuffer.first, 1, &signalCopyRegion);
+	signalCopyRegion.srcOffset = first + sizeof(glm::vec2) * (props.spec_height / 2);
+	signalCopyRegion.size = signalSize;
+	vkCmdCopyBuffer(chunk.cmdBuffTrackCopy, trackBuffer.first, chunk.signalRawBuffer.first, 1, &signalCopyRegion);
+	vkEndCommandBuffer(chunk.cmdBuffTrackCopy);
+	submitFiltering(chunk, &chunk.submitInfoTrackCopy, isAnalyze);
+}
 
-#ifdef PROFILING
-	end = std::chrono::high_resolution_clock::now();
-	time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << "filtering: " << time_ms << ' ';
-	start = std::chrono::high_resolution_clock::now();
-#endif
+void SDFTFilter::stageMask(Chunk& chunk, int* mask)
+{
+	uint32_t size = props.hostMaskHeight * props.segment_width * sizeof(int);
+	memcpy(chunk.maskHostMapped, mask, size);
 }
 
-void SDFTFilter::update(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut)
+void SDFTFilter::submitFiltering(Chunk& chunk, VkSubmitInfo* upload, bool isAnalyze)
+{
+	// Every stage waits for the timeline value of the previous one
+	if (upload) {
+		if (vkQueueSubmit(transferQueue, 1, upload, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Cannot submit to signal upload queue");
+	}
+	else {
+		// The unpadded copy the upload would have made, spec_height/2 samples into the extended signal
+		size_t signalLen = props.spec_height + props.hop * props.segment_width;
+		memcpy(chunk.rawMapped, (glm::vec2*)chunk.uploadMapped + props.spec_height / 2, sizeof(glm::vec2) * signalLen);
+		signalHostUpload(chunk);
+	}
+	if (vkQueueSubmit(chunk.computeQueue, 1, &chunk.submitInfoMaskRead, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Cannot submit to filtering queue");
+	if (processMode == PROCESS_STFT_MASK) {
+		if (vkQueueSubmit(chunk.computeQueue, 1, &chunk.submitInfoSTFT, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Cannot submit to filtering queue");
+	}
+	else {
+		if (vkQueueSubmit(chunk.computeQueue, 1, &chunk.submitInfoMaskSDFT, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Cannot submit to filtering queue");
+		if (vkQueueSubmit(chunk.computeQueue, 1, &chunk.submitInfoFilter, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Cannot submit to filtering queue");
+	}
+	if (isAnalyze) {
+		if (vkQueueSubmit(chunk.computeQueue, 1, &chunk.submitInfoAnalyze, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Cannot submit to filtering queue");
+		if (!isDirectIO && vkQueueSubmit(downloadQueue, 1, &chunk.submitInfoAnalysisDownload, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Cannot submit to signal download queue");
+		return;
+	}
+	if (!isDirectIO && vkQueueSubmit(downloadQueue, 1, &chunk.submitInfoSignalDownload, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Cannot submit to signal download queue");
+}
+
+void SDFTFilter::collectChunk(Chunk& chunk, std::vector<float>& signalOut, int stage)
 {
-	// Upload the signal onto GPU
 #ifdef PROFILING
 	auto start = std::chrono::high_resolution_clock::now();
 #endif
-	VkDeviceSize size = sizeof(glm::vec2) * signalIn.size();
-	std::vector<glm::vec2> input(signalIn.size());
-	// The signalIn must include spectrogram_height / 2 items from both sides
-	for (uint32_t i = 0; i < (uint32_t)input.size(); i++) {
-		input[i].x = signalIn[i];
-		input[i].y = 0;
-	}
+	waitStage(chunk, stage);
+	chunk.ticket = 0;
 #ifdef PROFILING
 	auto end = std::chrono::high_resolution_clock::now();
 	float time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << "Form signal: " << time_ms << ' ';
+	std::cout << "filtering: " << time_ms << ' ';
 	start = std::chrono::high_resolution_clock::now();
 #endif
-	void* memptr;
-	vkMapMemory(context.device, chunk.uploadBuffer.second, 0, size, 0, &memptr);
-	memcpy(memptr, input.data(), (size_t)size);
-	vkUnmapMemory(context.device, chunk.uploadBuffer.second);
+
+	if (props.filter_tolerance > 0 && processMode == PROCESS_FIR) {
+		FilterWindow* windows = (FilterWindow*)memoryPool.map(chunk.filterWindowBuffer.first);
+		filterError = 0;
+		filterTaps = 0;
+		for (int i = 0; i < props.segment_width; i++) {
+			filterError = std::max(filterError, windows[i].error);
+			filterTaps = std::max(filterTaps, 2 * windows[i].halfTaps);
+		}
+	}
+
+	// Output the results
+	signalOut.resize(props.spec_height + props.hop * props.segment_width);
+	const glm::vec2* outpt = chunk.signalMapped;
+	for (uint32_t i = 0; i < (uint32_t)signalOut.size(); i++) {
+		signalOut[i] = outpt[i].x;
+	}
 #ifdef PROFILING
 	end = std::chrono::high_resolution_clock::now();
 	time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << "copy mapped: " << time_ms << ' ';
-	start = std::chrono::high_resolution_clock::now();
+	std::cout << "from mapped: " << time_ms << std::endl << std::endl;
 #endif
+}
 
-	// Transfer into device local buffer
-	VkCommandBufferBeginInfo transferBufferBI = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+void SDFTFilter::releaseChunk(Chunk& chunk)
+{
+	if (chunk.ticket != 0)
+		collectChunk(chunk, finishedTickets[chunk.ticket]);
+}
+
+void SDFTFilter::startJob(Chunk& chunk)
+{
+	// Only idle chunks take jobs, so the counter holds the last value signalled by the previous one
+	uint64_t base;
+	if (vkGetSemaphoreCounterValue(context.device, chunk.timeline, &base) != VK_SUCCESS)
+		throw std::runtime_error("Cannot read chunk timeline");
+	for (int stage = 0; stage < STAGE_COUNT; stage++)
+		chunk.stageValues[stage] = base + stage;
+}
+
+void SDFTFilter::waitStage(Chunk& chunk, int stage)
+{
+	VkSemaphoreWaitInfo waitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
 		.pNext = 0,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-		.pInheritanceInfo = 0
-	};
-	vkBeginCommandBuffer(transferCommandBuffer, &transferBufferBI);
-	VkBufferCopy bufferCopyRegion = {
-		.srcOffset = (VkDeviceSize)(props.spec_height / 2 * sizeof(glm::vec2)),
-		.dstOffset = 0,
-		.size = size - (props.spec_height * sizeof(glm::vec2))
+		.flags = 0,
+		.semaphoreCount = 1,
+		.pSemaphores = &chunk.timeline,
+		.pValues = &chunk.stageValues[getHostStage(stage)]
 	};
-	vkCmdCopyBuffer(transferCommandBuffer, chunk.uploadBuffer.first, chunk.signalRawBuffer.first, 1, &bufferCopyRegion);
-	bufferCopyRegion.srcOffset = 0;
-	bufferCopyRegion.size = size;
-	vkCmdCopyBuffer(transferCommandBuffer, chunk.uploadBuffer.first, chunk.signalRawExtBuffer.first, 1, &bufferCopyRegion);
-	vkEndCommandBuffer(transferCommandBuffer);
+	if (vkWaitSemaphores(context.device, &waitInfo, (uint64_t)-1) != VK_SUCCESS)
+		throw std::runtime_error("Cannot wait for chunk timeline");
+}
 
+// The values are read from chunk.stageValues on every submission, so one submit info serves all jobs
+VkSubmitInfo SDFTFilter::createTimelineSubmit(Chunk& chunk, VkCommandBuffer* commandBuffer, VkTimelineSemaphoreSubmitInfo& timelineInfo,
+	VkPipelineStageFlags* waitStages, int waitStage, int signalStage)
+{
+	uint32_t waitCount = waitStage > 0 ? 1 : 0;
+	timelineInfo = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.pNext = 0,
+		.waitSemaphoreValueCount = waitCount,
+		.pWaitSemaphoreValues = waitCount ? &chunk.stageValues[waitStage] : 0,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &chunk.stageValues[signalStage]
+	};
 	VkSubmitInfo submitInfo = {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = 0,
-		.waitSemaphoreCount = 0,
+		.pNext = &timelineInfo,
+		.waitSemaphoreCount = waitCount,
+		.pWaitSemaphores = waitCount ? &chunk.timeline : 0,
+		.pWaitDstStageMask = waitStages,
+		.commandBufferCount = 1,
+		.pCommandBuffers = commandBuffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &chunk.timeline
+	};
+	return submitInfo;
+}
+
+glm::vec2* SDFTFilter::stageUpdate()
+{
+	Chunk& chunk = chunks[nextTicket % chunks.size()];
+	releaseChunk(chunk);
+	isUpdateStaged = true;
+	return (glm::vec2*)chunk.uploadMapped;
+}
+
+uint64_t SDFTFilter::commitUpdate(int* mask)
+{
+	if (!isUpdateStaged)
+		throw std::runtime_error("commitUpdate without stageUpdate");
+	isUpdateStaged = false;
+	uint64_t ticket = nextTicket++;
+	Chunk& chunk = chunks[ticket % chunks.size()];
+	startJob(chunk);
+	stageMask(chunk, mask);
+	submitFiltering(chunk, isDirectIO ? nullptr : &chunk.submitInfoSignalUpload, false);
+	chunk.ticket = ticket;
+	return ticket;
+}
+
+uint64_t SDFTFilter::submitUpdate(int* mask, const std::vector<float>& signalIn)
+{
+	uint64_t ticket = nextTicket++;
+	Chunk& chunk = chunks[ticket % chunks.size()];
+	releaseChunk(chunk);
+	submitChunk(chunk, mask, signalIn);
+	chunk.ticket = ticket;
+	return ticket;
+}
+
+bool SDFTFilter::poll(uint64_t ticket)
+{
+	if (finishedTickets.count(ticket))
+		return true;
+	Chunk& chunk = chunks[ticket % chunks.size()];
+	if (chunk.ticket != ticket)
+		throw std::runtime_error("Unknown or already collected ticket");
+	uint64_t value;
+	if (vkGetSemaphoreCounterValue(context.device, chunk.timeline, &value) != VK_SUCCESS)
+		throw std::runtime_error("Cannot read chunk timeline");
+	return value >= chunk.stageValues[getHostStage(STAGE_DOWNLOADED)];
+}
+
+void SDFTFilter::wait(uint64_t ticket, std::vector<float>& signalOut)
+{
+	auto finished = finishedTickets.find(ticket);
+	if (finished != finishedTickets.end()) {
+		signalOut = std::move(finished->second);
+		finishedTickets.erase(finished);
+		return;
+	}
+	Chunk& chunk = chunks[ticket % chunks.size()];
+	if (chunk.ticket != ticket)
+		throw std::runtime_error("Unknown or already collected ticket");
+	collectChunk(chunk, signalOut);
+}
+
+void SDFTFilter::update(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut)
+{
+	wait(submitUpdate(mask, signalIn), signalOut);
+}
+
+void SDFTFilter::loadSignal(const std::vector<float>& signalIn)
+{
+	loadSignal(signalIn.data(), signalIn.size(), PCM_FLOAT32, false);
+}
+
+// The track keeps spec_height / 2 zeros in front, so chunk k starts at k * chunkLen like the chunks of processSignal.
+// Only the compact samples cross the bus, pcm_expand.comp widens them into the complex track on the device
+void SDFTFilter::loadSignal(const void* samples, size_t count, int format, bool isNormalize)
+{
+	if (format != PCM_FLOAT32 && format != PCM_INT16)
+		throw std::runtime_error("Unknown PCM sample format");
+	int chunkLen = props.hop * props.segment_width + props.spec_height;
+	int chunkCount = getChunkCount((int)count);
+	size_t trackLen = (size_t)chunkCount * chunkLen + props.spec_height;
+	VkDeviceSize size = sizeof(glm::vec2) * trackLen;
+	size_t sampleSize = format == PCM_INT16 ? sizeof(int16_t) : sizeof(float);
+	// Whole words, the shaders read int16 samples in pairs
+	VkDeviceSize pcmSize = std::max<VkDeviceSize>((count * sampleSize + 3) / 4 * 4, 4);
+
+	if (pcmExpandPipeline == VK_NULL_HANDLE)
+		createPCMPipelines();
+
+	// Jobs in flight may still read the old track
+	vkDeviceWaitIdle(context.device);
+	descriptorAllocator.free(trackDSet);
+	memoryPool.destroyBuffer(trackBuffer);
+	// A reload is the reconfiguration point, the new track is placed after the ring is packed
+	compactMemory();
+	createStorageBuffer(size, trackBuffer, trackBinding);
+	trackDSet = descriptorAllocator.allocate({ trackBinding }, sdftDescriptorSetLayout);
+	trackChunks = chunkCount;
+
+	std::pair<VkBuffer, VkDeviceMemory> staging, pcmBuffer, peakBuffer;
+	Binding stagingBinding, pcmBinding, peakBinding;
+	std::pair <VkDescriptorSet, VkDescriptorPool> pcmDSet, peakDSet;
+	createStorageBuffer(pcmSize, staging, stagingBinding, true);
+	createStorageBuffer(pcmSize, pcmBuffer, pcmBinding);
+	createStorageBuffer(sizeof(uint32_t), peakBuffer, peakBinding);
+	pcmDSet = descriptorAllocator.allocate({ pcmBinding }, sdftDescriptorSetLayout);
+	peakDSet = descriptorAllocator.allocate({ peakBinding }, sdftDescriptorSetLayout);
+	memcpy(memoryPool.map(staging.first), samples, count * sampleSize);
+
+	// The conversion runs on the compute queue of the first chunk, the track buffers are shared with its family
+	Chunk& chunk = chunks[0];
+	VkCommandBuffer commandBuffer;
+	VkCommandBufferAllocateInfo commandBufferAI = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = 0,
+		.commandPool = chunk.cmdPoolCompute,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1
+	};
+	if (vkAllocateCommandBuffers(context.device, &commandBufferAI, &commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create signal conversion command buffer");
+	VkCommandBufferBeginInfo commandBufferBI = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = 0,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = 0
+	};
+	vkBeginCommandBuffer(commandBuffer, &commandBufferBI);
+	VkBufferCopy bufferCopyRegion = {
+		.srcOffset = 0,
+		.dstOffset = 0,
+		.size = pcmSize
+	};
+	vkCmdCopyBuffer(commandBuffer, staging.first, pcmBuffer.first, 1, &bufferCopyRegion);
+	vkCmdFillBuffer(commandBuffer, peakBuffer.first, 0, VK_WHOLE_SIZE, 0);
+	VkMemoryBarrier pcmBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.pNext = 0,
+		.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0, 1, &pcmBarrier, 0, nullptr, 0, nullptr);
+
+	PCMState state = {
+		.count = (int)count,
+		.format = format,
+		.pad = props.spec_height / 2,
+		.track_len = (int)trackLen,
+		.is_normalize = isNormalize ? 1 : 0
+	};
+	// Grid-stride loops, a few thousand groups keep the device busy
+	uint32_t maxGroups = 4096;
+	std::vector< VkDescriptorSet> pipeIO = { pcmDSet.first, peakDSet.first, trackDSet.first };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pcmPipelineLayout, 0, (uint32_t)pipeIO.size(), pipeIO.data(), 0, 0);
+	vkCmdPushConstants(commandBuffer, pcmPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PCMState), &state);
+	if (isNormalize) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pcmPeakPipeline);
+		vkCmdDispatch(commandBuffer, std::min<uint32_t>((uint32_t)((count + 255) / 256), maxGroups), 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 1, &pcmBarrier, 0, nullptr, 0, nullptr);
+	}
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pcmExpandPipeline);
+	vkCmdDispatch(commandBuffer, std::min<uint32_t>((uint32_t)((trackLen + 255) / 256), maxGroups), 1, 1);
+	vkEndCommandBuffer(commandBuffer);
+	VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = 0,
+		.waitSemaphoreCount = 0,
 		.pWaitSemaphores = 0,
 		.pWaitDstStageMask = 0,
 		.commandBufferCount = 1,
-		.pCommandBuffers = &transferCommandBuffer,
+		.pCommandBuffers = &commandBuffer,
 		.signalSemaphoreCount = 0,
 		.pSignalSemaphores = 0
 	};
-	vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(transferQueue);
-#ifdef PROFILING
-	end = std::chrono::high_resolution_clock::now();
-	time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << "to device_local: " << time_ms << ' ';
-	start = std::chrono::high_resolution_clock::now();
-#endif
+	if (vkQueueSubmit(chunk.computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Cannot submit the signal track conversion");
+	vkQueueWaitIdle(chunk.computeQueue);
+	vkFreeCommandBuffers(context.device, chunk.cmdPoolCompute, 1, &commandBuffer);
+	descriptorAllocator.free(pcmDSet);
+	descriptorAllocator.free(peakDSet);
+	memoryPool.destroyBuffer(staging);
+	memoryPool.destroyBuffer(pcmBuffer);
+	memoryPool.destroyBuffer(peakBuffer);
+	// The old track and the conversion buffers may have left whole blocks empty
+	memoryPool.trim();
+}
+
+void SDFTFilter::compactMemory()
+{
+	// Chunks holding uncollected results or a staged update keep their buffers
+	if (isUpdateStaged)
+		return;
+	for (Chunk& chunk : chunks) {
+		if (chunk.ticket != 0)
+			return;
+	}
+	if (!memoryPool.isFragmented())
+		return;
+	rebuildChunks();
+}
 
-	// Process the signal
-	update(chunk, mask);
+void SDFTFilter::rebuildChunks()
+{
+	// Descriptors and the prerecorded buffers point at the old ranges, so the whole ring is rebuilt
+	vkDeviceWaitIdle(context.device);
+	for (Chunk& chunk : chunks)
+		destroyChunk(chunk);
+	memoryPool.trim();
+	for (Chunk& chunk : chunks)
+		initChunk(chunk);
+	for (Chunk& chunk : chunks)
+		recordChunk(chunk);
+}
 
-#ifdef PROFILING
-	end = std::chrono::high_resolution_clock::now();
-	time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << std::endl << "Overall processing: " << time_ms << std::endl;
-	start = std::chrono::high_resolution_clock::now();
-#endif
-	// Output the results
-	signalOut.resize(props.spec_height + props.hop * props.segment_width);
-	VkDeviceSize signalSize = sizeof(glm::vec2) * signalOut.size();
+int SDFTFilter::getTrackChunks()
+{
+	return trackChunks;
+}
 
-	vkBeginCommandBuffer(transferCommandBuffer, &transferBufferBI);
-	VkBufferCopy signalBufferCopyRegion = {
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = signalSize
-	};
-	vkCmdCopyBuffer(transferCommandBuffer, chunk.signalFiltBuffer.first, chunk.bufferSignal.first, 1, &signalBufferCopyRegion);
-	vkEndCommandBuffer(transferCommandBuffer);
+uint64_t SDFTFilter::submitUpdateAt(int* mask, int chunkIndex)
+{
+	uint64_t ticket = nextTicket++;
+	Chunk& chunk = chunks[ticket % chunks.size()];
+	releaseChunk(chunk);
+	submitTrackChunk(chunk, mask, chunkIndex, false);
+	chunk.ticket = ticket;
+	return ticket;
+}
 
-	vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(transferQueue);
+void SDFTFilter::updateAt(int* mask, int chunkIndex, std::vector<float>& signalOut)
+{
+	wait(submitUpdateAt(mask, chunkIndex), signalOut);
+}
 
-#ifdef PROFILING
-	end = std::chrono::high_resolution_clock::now();
-	time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << "to host_local: " << time_ms << ' ';
-	start = std::chrono::high_resolution_clock::now();
-#endif
-	//void* memptr;
-	vkMapMemory(context.device, chunk.bufferSignal.second, 0, signalSize, 0, &memptr);
-	// memcpy(signalOut.data(), memptr, signalSize);
-	float* outpt = (float* )memptr;
-	for (uint32_t i = 0; i < (uint32_t)signalOut.size(); i++) {
-		signalOut[i] = outpt[i * 2];
+void SDFTFilter::updateAndAnalyzeAt(int* mask, int chunkIndex, std::vector<float>& signalOut, std::vector<float>& specOut)
+{
+	Chunk& chunk = chunks[nextTicket++ % chunks.size()];
+	releaseChunk(chunk);
+	submitTrackChunk(chunk, mask, chunkIndex, true);
+	collectChunk(chunk, signalOut, STAGE_ANALYSIS_DOWNLOADED);
+	specOut.resize(props.spec_height * props.segment_width);
+	readSpectrogram(chunk, props.segment_width, specOut.data(), true);
+}
+
+void SDFTFilter::updateAndAnalyze(int* mask, const std::vector<float>& signalIn, std::vector<float>& signalOut, std::vector<float>& specOut)
+{
+	// Takes a ticket slot without handing the ticket out, the results are read here
+	Chunk& chunk = chunks[nextTicket++ % chunks.size()];
+	releaseChunk(chunk);
+	submitChunk(chunk, mask, signalIn, true);
+	collectChunk(chunk, signalOut, STAGE_ANALYSIS_DOWNLOADED);
+	specOut.resize(props.spec_height * props.segment_width);
+	readSpectrogram(chunk, props.segment_width, specOut.data(), true);
+}
+
+void SDFTFilter::updateRing(const std::vector<int*>& masks, const std::vector<std::vector<float>>& signalsIn, std::vector<std::vector<float>>& signalsOut)
+{
+	if (masks.size() != signalsIn.size())
+		throw std::runtime_error("Every chunk needs a mask and a signal");
+	int ring = (int)chunks.size();
+	int count = (int)signalsIn.size();
+	signalsOut.resize(count);
+	// A ring slot is reused only after its previous chunk is read back, so while chunk i is staged
+	// the chunks up to i - 1 keep uploading, filtering and downloading on their own queues
+	std::vector<uint64_t> tickets(count);
+	for (int i = 0; i < count + ring; i++) {
+		if (i >= ring)
+			wait(tickets[i - ring], signalsOut[i - ring]);
+		if (i < count)
+			tickets[i] = submitUpdate(masks[i], signalsIn[i]);
+	}
+}
+
+int SDFTFilter::getChunkCount(int signalLength)
+{
+	int chunkLen = props.hop * props.segment_width + props.spec_height;
+	return (signalLength + chunkLen - 1) / chunkLen;
+}
+
+// Chunk k filters samples [k * chunkLen, (k + 1) * chunkLen) and reads spec_height / 2 more on both sides
+void SDFTFilter::processSignal(int* mask, int maskColumns, const std::vector<float>& signalIn, std::vector<float>& signalOut)
+{
+	int chunkLen = props.hop * props.segment_width + props.spec_height;
+	int inLen = chunkLen + props.spec_height;
+	long long pad = props.spec_height / 2;
+	long long signalLen = (long long)signalIn.size();
+	int count = getChunkCount((int)signalIn.size());
+	if (maskColumns < count * props.segment_width)
+		throw std::runtime_error("Mask is narrower than the chunks covering the signal");
+	size_t maskStride = (size_t)props.hostMaskHeight * props.segment_width;
+	int ring = (int)chunks.size();
+	signalOut.resize(signalIn.size());
+
+	std::vector<float> chunkIn(inLen);
+	std::vector<float> chunkOut;
+	std::vector<uint64_t> tickets(count);
+	for (int i = 0; i < count + ring; i++) {
+		if (i >= ring) {
+			int k = i - ring;
+			wait(tickets[k], chunkOut);
+			long long start = (long long)k * chunkLen;
+			long long len = std::min((long long)chunkLen, signalLen - start);
+			std::copy(chunkOut.begin(), chunkOut.begin() + len, signalOut.begin() + start);
+		}
+		if (i < count) {
+			// submitUpdate stages the samples right away, so the buffer is refilled for the next chunk
+			long long first = (long long)i * chunkLen - pad;
+			for (int j = 0; j < inLen; j++) {
+				long long n = first + j;
+				chunkIn[j] = n >= 0 && n < signalLen ? signalIn[n] : 0.0f;
+			}
+			tickets[i] = submitUpdate(mask + maskStride * i, chunkIn);
+		}
 	}
-	vkUnmapMemory(context.device, chunk.bufferSignal.second);
-#ifdef PROFILING
-	end = std::chrono::high_resolution_clock::now();
-	time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << "from mapped: " << time_ms << std::endl << std::endl;
-#endif
 }
 
 void SDFTFilter::calcSDFT(const std::vector<float>& signalIn, std::vector<float>& specOut)
 {
+	Chunk& chunk = chunks[nextSpecChunk];
+	nextSpecChunk = (nextSpecChunk + 1) % (int)chunks.size();
+	releaseChunk(chunk);
+	startJob(chunk);
 #ifdef PROFILING
 	auto start = std::chrono::high_resolution_clock::now();
 #endif
 	// Upload the signal onto GPU
-	VkDeviceSize size = sizeof(glm::vec2) * signalIn.size();
-	std::vector<glm::vec2> input(signalIn.size());
 	// The signalIn must include spectrogram_height / 2 items from both sides
-	for (uint32_t i = 0; i < (uint32_t)input.size(); i++) {
-		input[i].x = signalIn[i];
-		input[i].y = 0;
+	if (signalIn.size() > (size_t)props.hop * props.segment_width + 2 * props.spec_height)
+		throw std::runtime_error("Chunk signal is longer than hop * segment_width + 2 * spec_height");
+	if (props.real_fft) {
+		// Samples are consumed in pairs as x[2n] + i*x[2n+1], so the floats go as they are
+		memcpy(chunk.uploadMapped, signalIn.data(), sizeof(float) * signalIn.size());
+	}
+	else {
+		glm::vec2* staged = (glm::vec2*)chunk.uploadMapped;
+		for (size_t i = 0; i < signalIn.size(); i++)
+			staged[i] = glm::vec2(signalIn[i], 0.0f);
 	}
 
 #ifdef PROFILING
 	auto end = std::chrono::high_resolution_clock::now();
 	float time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-	std::cout << "From signal: " << time_ms << ' ';
-	start = std::chrono::high_resolution_clock::now();
-#endif
-	void* memptr;
-	vkMapMemory(context.device, chunk.uploadBuffer.second, 0, size, 0, &memptr);
-	memcpy(memptr, input.data(), (uint32_t)size);
-	vkUnmapMemory(context.device, chunk.uploadBuffer.second);
-
-#ifdef PROFILING
-	end = std::chrono::high_resolution_clock::now();
-	time_ms = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 	std::cout << "to mapped: " << time_ms << ' ';
 	start = std::chrono::high_resolution_clock::now();
 #endif
-	if (vkQueueSubmit(transferQueue, 1, &chunk.submitInfoSDFTUpload, VK_NULL_HANDLE) != VK_SUCCESS)
+	if (isDirectIO)
+		signalHostUpload(chunk);
+	else if (vkQueueSubmit(transferQueue, 1, &chunk.submitInfoSDFTUpload, VK_NULL_HANDLE) != VK_SUCCESS)
 		throw std::runtime_error("Cannot submit to SDFT Upload queue");
-	if (vkQueueSubmit(rawSDFTQueue, 1, &chunk.submitInfoSDFTProcess, VK_NULL_HANDLE) != VK_SUCCESS)
+	if (vkQueueSubmit(chunk.computeQueue, 1, &chunk.submitInfoSDFTProcess, VK_NULL_HANDLE) != VK_SUCCESS)
 		throw std::runtime_error("Cannot submit to SDFT Process queue");
-	if (vkQueueSubmit(transferQueue, 1, &chunk.submitInfoSDFTDownload, chunk.fenceSDFT) != VK_SUCCESS)
+	if (!isDirectIO && vkQueueSubmit(transferQueue, 1, &chunk.submitInfoSDFTDownload, VK_NULL_HANDLE) != VK_SUCCESS)
 		throw std::runtime_error("Cannot submit to SDFT Download queue");
 
 	// Output the results
-	specOut.resize(props.spec_height * props.segment_width);
-	VkDeviceSize specSize = sizeof(glm::vec2) * specOut.size();
-	vkWaitForFences(context.device, 1, &chunk.fenceSDFT, VK_TRUE, (uint64_t)-1);
-	vkResetFences(context.device, 1, &chunk.fenceSDFT);
+	waitStage(chunk, STAGE_SPEC_DOWNLOADED);
 
 #ifdef PROFILING
 	end = std::chrono::high_resolution_clock::now();
@@ -661,11 +1242,8 @@ void SDFTFilter::calcSDFT(const std::vector<float>& signalIn, std::vector<float>
 	std::cout << std::endl << "SDFT overall: " << time_ms << ' ';
 	start = std::chrono::high_resolution_clock::now();
 #endif
-	vkMapMemory(context.device, chunk.bufferSpec.second, 0, specSize, 0, &memptr);
-	for (uint32_t i = 0; i < (uint32_t)specOut.size(); i++) {
-		specOut[i] = sqrt(((float*)memptr)[i*2] * ((float*)memptr)[i*2] + ((float*)memptr)[i*2 + 1] * ((float*)memptr)[i*2 + 1]);
-	}
-	vkUnmapMemory(context.device, chunk.bufferSpec.second);
+	specOut.resize(props.spec_height * props.segment_width);
+	readSpectrogram(chunk, props.segment_width, specOut.data());
 
 #ifdef PROFILING
 	end = std::chrono::high_resolution_clock::now();
@@ -674,6 +1252,211 @@ void SDFTFilter::calcSDFT(const std::vector<float>& signalIn, std::vector<float>
 #endif
 }
 
+void SDFTFilter::calcSDFTBatch(const std::vector<float>& signalIn, int count, std::vector<float>& specOut)
+{
+	if (count < 1 || count > batchSize)
+		throw std::runtime_error("Batch must hold 1 to batch_size chunks");
+	if (signalIn.size() > (size_t)props.hop * props.segment_width * count + 2 * props.spec_height)
+		throw std::runtime_error("Signal is longer than the batched chunks");
+	if (count == 1) {
+		calcSDFT(signalIn, specOut);
+		return;
+	}
+	Chunk& chunk = chunks[nextSpecChunk];
+	nextSpecChunk = (nextSpecChunk + 1) % (int)chunks.size();
+	// The whole batch is staged, chunks past count are transformed from zeros and dropped
+	submitSpectrogram(chunk, signalIn, 0);
+	waitStage(chunk, STAGE_SPEC_DOWNLOADED);
+	specOut.resize((size_t)props.spec_height * props.segment_width * count);
+	readSpectrogram(chunk, props.segment_width * count, specOut.data());
+}
+
+int SDFTFilter::getBatchSize()
+{
+	return batchSize;
+}
+
+int SDFTFilter::getSpectrogramColumns(int signalLength)
+{
+	return (signalLength + props.hop - 1) / props.hop;
+}
+
+// Batches of batch_size * segment_width columns go round the ring, a chunk is read back
+// right before it takes the batch ring_size places further
+void SDFTFilter::computeSpectrogram(const std::vector<float>& signalIn, float* specOut)
+{
+	int columns = getSpectrogramColumns((int)signalIn.size());
+	int batchColumns = props.segment_width * batchSize;
+	int count = (columns + batchColumns - 1) / batchColumns;
+	int ring = (int)chunks.size();
+	int first = nextSpecChunk;
+	nextSpecChunk = (nextSpecChunk + count) % ring;
+	for (int i = 0; i < count + ring; i++) {
+		if (i >= ring) {
+			int b = i - ring;
+			Chunk& chunk = chunks[(first + b) % ring];
+			waitStage(chunk, STAGE_SPEC_DOWNLOADED);
+			readSpectrogram(chunk, std::min(batchColumns, columns - b * batchColumns), specOut + (size_t)props.spec_height * batchColumns * b);
+		}
+		if (i < count) {
+			// Column t is centered on sample t * hop
+			long long start = (long long)i * batchColumns * props.hop - props.spec_height / 2;
+			submitSpectrogram(chunks[(first + i) % ring], signalIn, start);
+		}
+	}
+}
+
+// Stages hop * segment_width * batch_size + spec_height samples from first on, zeros outside the signal
+void SDFTFilter::submitSpectrogram(Chunk& chunk, const std::vector<float>& signalIn, long long first)
+{
+	releaseChunk(chunk);
+	startJob(chunk);
+	long long samples = (long long)props.hop * props.segment_width * batchSize + props.spec_height;
+	long long signalLen = (long long)signalIn.size();
+	if (props.real_fft) {
+		float* staged = (float*)chunk.uploadMapped;
+		for (long long i = 0; i < samples; i++)
+			staged[i] = first + i >= 0 && first + i < signalLen ? signalIn[first + i] : 0.0f;
+	}
+	else {
+		glm::vec2* staged = (glm::vec2*)chunk.uploadMapped;
+		for (long long i = 0; i < samples; i++)
+			staged[i] = glm::vec2(first + i >= 0 && first + i < signalLen ? signalIn[first + i] : 0.0f, 0.0f);
+	}
+
+	bool isBatched = batchSize > 1;
+	if (isDirectIO)
+		signalHostUpload(chunk);
+	else if (vkQueueSubmit(transferQueue, 1, isBatched ? &chunk.submitInfoSpecBatchUpload : &chunk.submitInfoSDFTUpload, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Cannot submit to SDFT Upload queue");
+	if (vkQueueSubmit(chunk.computeQueue, 1, isBatched ? &chunk.submitInfoSpecBatchProcess : &chunk.submitInfoSDFTProcess, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Cannot submit to SDFT Process queue");
+	if (!isDirectIO &&
+		vkQueueSubmit(downloadQueue, 1, isBatched ? &chunk.submitInfoSpecBatchDownload : &chunk.submitInfoSDFTDownload, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Cannot submit to SDFT Download queue");
+}
+
+void SDFTFilter::readSpectrogram(Chunk& chunk, int columns, float* specOut, bool isFullSpectrum)
+{
+	bool isHalfSpectrum = props.real_fft && !isFullSpectrum;
+	size_t specCount = (size_t)props.spec_height * columns;
+	const float* memptr = (const float*)chunk.specMapped;
+	if (isHalfSpectrum) {
+		// Bins 0..spec_height/2 are downloaded, the negative frequencies mirror them into the shifted column
+		int half = props.spec_height / 2;
+		for (int col = 0; col < columns; col++) {
+			const float* bins = memptr + col * (half + 1) * 2;
+			float* column = specOut + col * props.spec_height;
+			for (int k = 0; k <= half; k++) {
+				float magnitude = sqrt(bins[k * 2] * bins[k * 2] + bins[k * 2 + 1] * bins[k * 2 + 1]);
+				column[(k + half) % props.spec_height] = magnitude;
+				if (k > 0 && k < half) column[half - k] = magnitude;
+			}
+		}
+	}
+	else {
+		for (size_t i = 0; i < specCount; i++) {
+			specOut[i] = sqrt(memptr[i*2] * memptr[i*2] + memptr[i*2 + 1] * memptr[i*2 + 1]);
+		}
+	}
+}
+
+void SDFTFilter::setProcessMode(int mode)
+{
+	if (mode != PROCESS_FIR && mode != PROCESS_STFT_MASK)
+		throw std::runtime_error("Unknown process mode");
+	// Below half overlap the squared Hann windows leave gaps in the overlap-add
+	if (mode == PROCESS_STFT_MASK && props.hop > props.spec_height / 2)
+		throw std::runtime_error("STFT masking requires hop <= spec_height / 2");
+	// Before createDescriptorSets the pipelines are left to it, initChunk sizes the chunks for the mode
+	bool isFirstSTFT = mode == PROCESS_STFT_MASK && stftFramePipeline == VK_NULL_HANDLE && stftPipelineLayout != VK_NULL_HANDLE;
+	if (isFirstSTFT && isUpdateStaged)
+		throw std::runtime_error("Cannot switch to STFT masking between stageUpdate and commitUpdate");
+	processMode = mode;
+	if (isFirstSTFT) {
+		// The frame buffers and the wider FFT temps come with a rebuilt ring, pending results are parked first
+		for (Chunk& chunk : chunks)
+			releaseChunk(chunk);
+		createSTFTPipelines();
+		rebuildChunks();
+	}
+}
+
+void SDFTFilter::createPCMPipelines()
+{
+	Shader pcmPeak = getShaderModule(context.device, "Shaders/pcm_peak.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader pcmExpand = getShaderModule(context.device, "Shaders/pcm_expand.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	VkComputePipelineCreateInfo computePipelineCI = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.pNext = 0,
+		.flags = 0,
+		.stage = pcmPeak.stageCI,
+		.layout = pcmPipelineLayout,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = 0
+	};
+	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &pcmPeakPipeline) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline");
+	computePipelineCI.stage = pcmExpand.stageCI;
+	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &pcmExpandPipeline) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline");
+	vkDestroyShaderModule(context.device, pcmPeak.shaderModule, 0);
+	vkDestroyShaderModule(context.device, pcmExpand.shaderModule, 0);
+}
+
+void SDFTFilter::createSTFTPipelines()
+{
+	Shader stftFrame = getShaderModule(context.device, "Shaders/stft_frame.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader stftMask = getShaderModule(context.device, "Shaders/stft_mask.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader stftOla = getShaderModule(context.device, "Shaders/stft_ola.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	VkComputePipelineCreateInfo computePipelineCI = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.pNext = 0,
+		.flags = 0,
+		.stage = stftFrame.stageCI,
+		.layout = stftPipelineLayout,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = 0
+	};
+	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &stftFramePipeline) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline");
+	computePipelineCI.stage = stftMask.stageCI;
+	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &stftMaskPipeline) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline");
+	computePipelineCI.stage = stftOla.stageCI;
+	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &stftOlaPipeline) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline");
+	vkDestroyShaderModule(context.device, stftFrame.shaderModule, 0);
+	vkDestroyShaderModule(context.device, stftMask.shaderModule, 0);
+	vkDestroyShaderModule(context.device, stftOla.shaderModule, 0);
+}
+
+void SDFTFilter::recordSTFTChunk(Chunk& chunk)
+{
+	VkCommandBufferBeginInfo bufferBI = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = 0,
+		.flags = 0,
+		.pInheritanceInfo = 0
+	};
+	if (vkBeginCommandBuffer(chunk.cmdBuffSTFT, &bufferBI) != VK_SUCCESS)
+		throw std::runtime_error("Cannot begin STFT masking buffer");
+	recordSTFTMask(chunk.cmdBuffSTFT, chunk);
+	recordHostBarrier(chunk.cmdBuffSTFT);
+	if (vkEndCommandBuffer(chunk.cmdBuffSTFT) != VK_SUCCESS)
+		throw std::runtime_error("Cannot end STFT masking buffer");
+}
+
+float SDFTFilter::getFilterError()
+{
+	return filterError;
+}
+
+int SDFTFilter::getFilterTaps()
+{
+	return filterTaps;
+}
+
 int SDFTFilter::getSpecWidth()
 {
 	return (int)(props.spec_height * (ceil((double)props.max_signal_size / props.hop) + 1));
@@ -683,9 +1466,12 @@ void SDFTFilter::createDescriptorSets()
 {
 	// Pipelines
 	Shader sdft = getShaderModule(context.device, "Shaders/sdft.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader sdft4 = getShaderModule(context.device, "Shaders/sdft4.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader sdft8 = getShaderModule(context.device, "Shaders/sdft8.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader sdftShared = getShaderModule(context.device, "Shaders/sdft_shared.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 	Shader read = getShaderModule(context.device, "Shaders/read.spv", VK_SHADER_STAGE_COMPUTE_BIT);
-	Shader filter = getShaderModule(context.device, "Shaders/filter.spv", VK_SHADER_STAGE_COMPUTE_BIT);
-	Shader sum = getShaderModule(context.device, "Shaders/sum.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader filter = getShaderModule(context.device, isHalfStorage ? "Shaders/filter_fp16.spv" : "Shaders/filter.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	Shader sum = getShaderModule(context.device, isHalfStorage ? "Shaders/sum_fp16.spv" : "Shaders/sum.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 	std::vector<VkDescriptorSetLayout> descriptorLayouts = { sdftDescriptorSetLayout , sdftDescriptorSetLayout };
 	VkPushConstantRange sdftConstantRange = {
 		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
@@ -707,18 +1493,22 @@ void SDFTFilter::createDescriptorSets()
 		.offset = 0,
 		.size = sizeof(SUMState)
 	};
+	// SDFT layout: <Input, Output, Twiddles>
+	std::vector<VkDescriptorSetLayout> sdftDescriptorLayouts = { sdftDescriptorSetLayout , sdftDescriptorSetLayout, sdftDescriptorSetLayout };
 	VkPipelineLayoutCreateInfo computeLayoutCI = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 		.pNext = 0,
 		.flags = 0,
-		.setLayoutCount = (uint32_t)descriptorLayouts.size(),
-		.pSetLayouts = (VkDescriptorSetLayout*)descriptorLayouts.data(),
+		.setLayoutCount = (uint32_t)sdftDescriptorLayouts.size(),
+		.pSetLayouts = (VkDescriptorSetLayout*)sdftDescriptorLayouts.data(),
 		.pushConstantRangeCount = 1,
 		.pPushConstantRanges = &sdftConstantRange
 	};
 	if (vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &sdftPipelineLayout) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create compute pipeline layout");
 
+	computeLayoutCI.setLayoutCount = (uint32_t)descriptorLayouts.size();
+	computeLayoutCI.pSetLayouts = (VkDescriptorSetLayout*)descriptorLayouts.data();
 	computeLayoutCI.pPushConstantRanges = &readConstantRange;
 	if (vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &readPipelineLayout) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create compute pipeline layout");
@@ -728,13 +1518,59 @@ void SDFTFilter::createDescriptorSets()
 		throw std::runtime_error("Cannot create compute pipeline layout");
 
 
+	// STFT layout: <Input, Output>
+	VkPushConstantRange stftConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(STFTState)
+	};
+	computeLayoutCI.pPushConstantRanges = &stftConstantRange;
+	if (vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &stftPipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline layout");
+
+	// Filter window layout: <Filters, Windows>
+	VkPushConstantRange windowConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(WindowState)
+	};
+	computeLayoutCI.pPushConstantRanges = &windowConstantRange;
+	if (props.filter_tolerance > 0 &&
+		vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &windowPipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline layout");
+
 	// LAYOUT CHANGED HERE
-	// Filter layout: <Filters, Input, Output>
+	// Filter layout: <Filters, Input, Output, Windows>
 	computeLayoutCI.pPushConstantRanges = &filterConstantRange;
 	descriptorLayouts.push_back(sdftDescriptorSetLayout);
+	std::vector<VkDescriptorSetLayout> filterDescriptorLayouts = descriptorLayouts;
+	filterDescriptorLayouts.push_back(sdftDescriptorSetLayout);
+	computeLayoutCI.setLayoutCount = (uint32_t)filterDescriptorLayouts.size();
+	computeLayoutCI.pSetLayouts = (VkDescriptorSetLayout*)filterDescriptorLayouts.data();
+	if (vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &filterPipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline layout");
 	computeLayoutCI.setLayoutCount = (uint32_t)descriptorLayouts.size();
 	computeLayoutCI.pSetLayouts = (VkDescriptorSetLayout*)descriptorLayouts.data();
-	if (vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &filterPipelineLayout) != VK_SUCCESS)
+
+	// Overlap-save layout: <Input, Input, Output>, the pack and blend passes bind the first two only
+	VkPushConstantRange olsConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(OLSState)
+	};
+	computeLayoutCI.pPushConstantRanges = &olsConstantRange;
+	if (props.fir_engine == FIR_OVERLAP_SAVE &&
+		vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &olsPipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create compute pipeline layout");
+
+	// PCM conversion layout: <Samples, Peak, Track>
+	VkPushConstantRange pcmConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(PCMState)
+	};
+	computeLayoutCI.pPushConstantRanges = &pcmConstantRange;
+	if (vkCreatePipelineLayout(context.device, &computeLayoutCI, 0, &pcmPipelineLayout) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create compute pipeline layout");
 
 	VkComputePipelineCreateInfo computePipelineCI = {
@@ -746,8 +1582,67 @@ void SDFTFilter::createDescriptorSets()
 		.basePipelineHandle = VK_NULL_HANDLE,
 		.basePipelineIndex = 0
 	};
-	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &sdftPipeline) != VK_SUCCESS)
-		throw std::runtime_error("Cannot create compute pipeline");
+
+	std::vector<Shader> radixShaders = { sdft, sdft4, sdft8 };
+	createFFTPipelines(fft, radixShaders, sdftShared);
+	if (isHalfStorage) {
+		std::vector<Shader> halfShaders = {
+			getShaderModule(context.device, "Shaders/sdft_fp16.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+			getShaderModule(context.device, "Shaders/sdft4_fp16.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+			getShaderModule(context.device, "Shaders/sdft8_fp16.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		};
+		Shader sdftSharedHalf = getShaderModule(context.device, "Shaders/sdft_shared_fp16.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		createFFTPipelines(filterFFT, radixShaders, sdftSharedHalf, &halfShaders);
+		for (Shader& shader : halfShaders)
+			vkDestroyShaderModule(context.device, shader.shaderModule, 0);
+		vkDestroyShaderModule(context.device, sdftSharedHalf.shaderModule, 0);
+	}
+	if (props.real_fft) {
+		createFFTPipelines(realFFT, radixShaders, sdftShared);
+		Shader rfftSplit = getShaderModule(context.device, "Shaders/rfft_split.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VkSpecializationMapEntry splitSpecEntry = { .constantID = 0, .offset = offsetof(FFTSpecialization, specHeight), .size = sizeof(int) };
+		FFTSpecialization splitSpec = {
+			.specHeight = props.spec_height,
+			.stageStride = 0,
+			.twiddleStep = 1
+		};
+		VkSpecializationInfo splitSpecInfo = {
+			.mapEntryCount = 1,
+			.pMapEntries = &splitSpecEntry,
+			.dataSize = sizeof(FFTSpecialization),
+			.pData = &splitSpec
+		};
+		computePipelineCI.stage = rfftSplit.stageCI;
+		computePipelineCI.stage.pSpecializationInfo = &splitSpecInfo;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &rfftSplitPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		vkDestroyShaderModule(context.device, rfftSplit.shaderModule, 0);
+	}
+
+	if (isRecursiveSDFT) {
+		Shader sdftSliding = getShaderModule(context.device, "Shaders/sdft_sliding.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		std::vector<VkSpecializationMapEntry> slidingSpecEntries = {
+			{ .constantID = 0, .offset = offsetof(SlidingSpecialization, specHeight), .size = sizeof(int) },
+			{ .constantID = 1, .offset = offsetof(SlidingSpecialization, columns), .size = sizeof(int) },
+			{ .constantID = 2, .offset = offsetof(SlidingSpecialization, isPacked), .size = sizeof(int) }
+		};
+		SlidingSpecialization slidingSpec = {
+			.specHeight = props.spec_height,
+			.columns = props.segment_width,
+			.isPacked = props.real_fft ? 1 : 0
+		};
+		VkSpecializationInfo slidingSpecInfo = {
+			.mapEntryCount = (uint32_t)slidingSpecEntries.size(),
+			.pMapEntries = slidingSpecEntries.data(),
+			.dataSize = sizeof(SlidingSpecialization),
+			.pData = &slidingSpec
+		};
+		computePipelineCI.stage = sdftSliding.stageCI;
+		computePipelineCI.stage.pSpecializationInfo = &slidingSpecInfo;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &sdftSlidingPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		vkDestroyShaderModule(context.device, sdftSliding.shaderModule, 0);
+	}
 
 	computePipelineCI.layout = readPipelineLayout;
 	computePipelineCI.stage = read.stageCI;
@@ -759,10 +1654,63 @@ void SDFTFilter::createDescriptorSets()
 	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &filterPipeline) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create compute pipeline");
 
+	if (isSubgroupReduce) {
+		Shader filterSubgroup = getShaderModule(context.device, isHalfStorage ? "Shaders/filter_subgroup_fp16.spv" : "Shaders/filter_subgroup.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCI.stage = filterSubgroup.stageCI;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &filterSubgroupPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		vkDestroyShaderModule(context.device, filterSubgroup.shaderModule, 0);
+	}
+	if (processMode == PROCESS_STFT_MASK)
+		createSTFTPipelines();
+
+	if (props.filter_tolerance > 0) {
+		Shader filterWindow = getShaderModule(context.device, isHalfStorage ? "Shaders/filter_window_fp16.spv" : "Shaders/filter_window.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCI.layout = windowPipelineLayout;
+		computePipelineCI.stage = filterWindow.stageCI;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &filterWindowPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		vkDestroyShaderModule(context.device, filterWindow.shaderModule, 0);
+		computePipelineCI.layout = filterPipelineLayout;
+	}
+	if (props.fir_engine == FIR_TILED) {
+		Shader filterTiled = getShaderModule(context.device, isHalfStorage ? "Shaders/filter_tiled_fp16.spv" : "Shaders/filter_tiled.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCI.stage = filterTiled.stageCI;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &filterTiledPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		vkDestroyShaderModule(context.device, filterTiled.shaderModule, 0);
+	}
+
 	computePipelineCI.layout = sumPipelineLayout;
 	computePipelineCI.stage = sum.stageCI;
 	if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &sumPipeline) != VK_SUCCESS)
 		throw std::runtime_error("Cannot create compute pipeline");
+	if (isHalfStorage) {
+		Shader sumLast = getShaderModule(context.device, "Shaders/sum_fp16_last.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCI.stage = sumLast.stageCI;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &sumLastPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		vkDestroyShaderModule(context.device, sumLast.shaderModule, 0);
+	}
+
+	if (props.fir_engine == FIR_OVERLAP_SAVE) {
+		Shader olsPack = getShaderModule(context.device, isHalfStorage ? "Shaders/ols_pack_fp16.spv" : "Shaders/ols_pack.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		Shader olsMac = getShaderModule(context.device, "Shaders/ols_mac.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		Shader olsBlend = getShaderModule(context.device, "Shaders/ols_blend.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCI.layout = olsPipelineLayout;
+		computePipelineCI.stage = olsPack.stageCI;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &olsPackPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		computePipelineCI.stage = olsMac.stageCI;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &olsMacPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		computePipelineCI.stage = olsBlend.stageCI;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &olsBlendPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		vkDestroyShaderModule(context.device, olsPack.shaderModule, 0);
+		vkDestroyShaderModule(context.device, olsMac.shaderModule, 0);
+		vkDestroyShaderModule(context.device, olsBlend.shaderModule, 0);
+	}
 
 	// Transfer command buffer
 	VkCommandPoolCreateInfo transferCommandPoolCI = {
@@ -785,16 +1733,62 @@ void SDFTFilter::createDescriptorSets()
 	vkDestroyShaderModule(context.device, filter.shaderModule, 0);
 	vkDestroyShaderModule(context.device, read.shaderModule, 0);
 	vkDestroyShaderModule(context.device, sdft.shaderModule, 0);
+	vkDestroyShaderModule(context.device, sdft4.shaderModule, 0);
+	vkDestroyShaderModule(context.device, sdft8.shaderModule, 0);
+	vkDestroyShaderModule(context.device, sdftShared.shaderModule, 0);
 	vkDestroyShaderModule(context.device, sum.shaderModule, 0);
 }
 
+void SDFTFilter::createTwiddles()
+{
+	// Computed in double precision, so every fp32 entry is correctly rounded even for large spec_height
+	VkDeviceSize size = sizeof(glm::vec2) * props.spec_height;
+	createStorageBuffer(size, twiddleBuffer, twiddleBinding);
+	std::pair<VkBuffer, VkDeviceMemory> staging = memoryPool.createBuffer({ (uint32_t)context.transferFamilyIdx },
+		size, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	glm::vec2* twiddles = (glm::vec2*)memoryPool.map(staging.first);
+	for (int m = 0; m < props.spec_height; m++) {
+		double angle = -2 * std::numbers::pi * m / props.spec_height;
+		twiddles[m] = glm::vec2((float)cos(angle), (float)sin(angle));
+	}
+
+	VkCommandBufferBeginInfo transferBufferBI = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = 0,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = 0
+	};
+	vkBeginCommandBuffer(transferCommandBuffer, &transferBufferBI);
+	VkBufferCopy bufferCopyRegion = {
+		.srcOffset = 0,
+		.dstOffset = 0,
+		.size = size
+	};
+	vkCmdCopyBuffer(transferCommandBuffer, staging.first, twiddleBuffer.first, 1, &bufferCopyRegion);
+	vkEndCommandBuffer(transferCommandBuffer);
+	VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = 0,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = 0,
+		.pWaitDstStageMask = 0,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &transferCommandBuffer,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = 0
+	};
+	vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	vkQueueWaitIdle(transferQueue);
+	memoryPool.destroyBuffer(staging);
+
+	twiddleDSet = descriptorAllocator.allocate({ twiddleBinding }, sdftDescriptorSetLayout);
+}
+
 void SDFTFilter::createStorageBuffer(VkDeviceSize size, std::pair<VkBuffer, VkDeviceMemory>& buffer, Binding& binding, bool is_host_visible)
 {
-	std::vector<uint32_t> queueFamilies = { (uint32_t)context.sdftFamilyIdx };
-	// if (is_drawing) queueFamilies.push_back((uint32_t)context.graphicsFamilyIdx);
 	VkMemoryPropertyFlags memProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 	if (is_host_visible) memProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	buffer = createBuffer(context.device, context.physicalDevice, queueFamilies,
+	buffer = memoryPool.createBuffer(bufferFamilies,
 		size, memProperties,
 		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 	binding.buffer.data = buffer.first;
@@ -804,27 +1798,561 @@ void SDFTFilter::createStorageBuffer(VkDeviceSize size, std::pair<VkBuffer, VkDe
 	binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 }
 
+void SDFTFilter::createIOBuffer(VkDeviceSize size, std::pair<VkBuffer, VkDeviceMemory>& buffer, Binding& binding)
+{
+	if (!isDirectIO) {
+		createStorageBuffer(size, buffer, binding);
+		return;
+	}
+	buffer = memoryPool.createBuffer(bufferFamilies, size,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	binding.buffer.data = buffer.first;
+	binding.buffer.step = 0;
+	binding.memory = buffer.second;
+	binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+}
+
+// Integrated and software devices have one memory, so staging copies only move data within it.
+// A discrete device qualifies with resizable BAR, when the host visible device heap is more than the legacy 256 MB window
+bool SDFTFilter::chooseDirectIO()
+{
+	if (props.memory_placement == MEMORY_STAGED) return false;
+	if (props.memory_placement != MEMORY_AUTO && props.memory_placement != MEMORY_DIRECT)
+		throw std::runtime_error("Unknown memory placement");
+	VkDeviceSize heapSize = getHostVisibleDeviceHeapSize(context.physicalDevice);
+	if (props.memory_placement == MEMORY_DIRECT) {
+		if (heapSize == 0)
+			throw std::runtime_error("Device has no host visible device local memory");
+		return true;
+	}
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(context.physicalDevice, &deviceProperties);
+	if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+		return heapSize > 0;
+	return heapSize > (256ull << 20);
+}
+
+void SDFTFilter::recordHostBarrier(VkCommandBuffer commandBuffer, bool isAlways)
+{
+	if (!isDirectIO && !isAlways)
+		return;
+	VkMemoryBarrier hostBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.pNext = 0,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+	};
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+}
+
+// Host writes before vkQueueSubmit are visible to the submitted work, so the compute stages may start right away
+void SDFTFilter::signalHostUpload(Chunk& chunk)
+{
+	VkSemaphoreSignalInfo signalInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+		.pNext = 0,
+		.semaphore = chunk.timeline,
+		.value = chunk.stageValues[STAGE_UPLOADED]
+	};
+	if (vkSignalSemaphore(context.device, &signalInfo) != VK_SUCCESS)
+		throw std::runtime_error("Cannot signal chunk timeline");
+}
+
+int SDFTFilter::getHostStage(int stage)
+{
+	if (!isDirectIO) return stage;
+	if (stage == STAGE_DOWNLOADED) return STAGE_FILTERED;
+	if (stage == STAGE_SPEC_DOWNLOADED) return STAGE_SPEC_PROCESSED;
+	if (stage == STAGE_ANALYSIS_DOWNLOADED) return STAGE_ANALYZED;
+	return stage;
+}
+
+
+// Splits log2(height) radix-2 stages into as few higher radix passes as allowed by props.fft_radix
+std::vector<int> SDFTFilter::getFFTStages(int height)
+{
+	int maxRadixLog = 1;
+	if (props.fft_radix == 4) maxRadixLog = 2;
+	else if (props.fft_radix == 8) maxRadixLog = 3;
+	else if (props.fft_radix != 0 && props.fft_radix != 2)
+		throw std::runtime_error("FFT radix must be 2, 4 or 8");
+
+	std::vector<int> stages;
+	int stagesLeft = (int)log2(height);
+	while (stagesLeft > 0) {
+		int radixLog = std::min(maxRadixLog, stagesLeft);
+		stages.push_back(1 << radixLog);
+		stagesLeft -= radixLog;
+	}
+	return stages;
+}
+
+void SDFTFilter::initFFTPlan(FFTPlan& plan, int height, uint32_t sharedMemorySize)
+{
+	plan.height = height;
+	plan.isShared = height <= SHARED_FFT_MAX_HEIGHT && sharedMemorySize >= height * sizeof(glm::vec2);
+	plan.stages = getFFTStages(height);
+	plan.pipelines.clear();
+	plan.sharedPipeline = VK_NULL_HANDLE;
+}
+
+// Pipelines are specialized on the transform length, the stage stride and the twiddle table step
+void SDFTFilter::createFFTPipelines(FFTPlan& plan, std::vector<Shader>& radixShaders, Shader sharedShader, std::vector<Shader>* lastShaders)
+{
+	VkComputePipelineCreateInfo computePipelineCI = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.pNext = 0,
+		.flags = 0,
+		.stage = sharedShader.stageCI,
+		.layout = sdftPipelineLayout,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = 0
+	};
+	std::vector<VkSpecializationMapEntry> fftSpecEntries = {
+		{ .constantID = 0, .offset = offsetof(FFTSpecialization, specHeight), .size = sizeof(int) },
+		{ .constantID = 1, .offset = offsetof(FFTSpecialization, stageStride), .size = sizeof(int) },
+		{ .constantID = 2, .offset = offsetof(FFTSpecialization, twiddleStep), .size = sizeof(int) }
+	};
+	FFTSpecialization fftSpec = {
+		.specHeight = plan.height,
+		.stageStride = 0,
+		.twiddleStep = props.spec_height / plan.height
+	};
+	VkSpecializationInfo specInfo = {
+		.mapEntryCount = (uint32_t)fftSpecEntries.size(),
+		.pMapEntries = fftSpecEntries.data(),
+		.dataSize = sizeof(FFTSpecialization),
+		.pData = &fftSpec
+	};
+
+	if (plan.isShared) {
+		computePipelineCI.stage.pSpecializationInfo = &specInfo;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &plan.sharedPipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		return;
+	}
+
+	int transformLength = 1;
+	for (int radix : plan.stages) {
+		fftSpec.stageStride = plan.height / (transformLength * radix);
+		std::vector<Shader>& shaders = lastShaders && transformLength * radix == plan.height ? *lastShaders : radixShaders;
+		if (radix == 2) computePipelineCI.stage = shaders[0].stageCI;
+		else if (radix == 4) computePipelineCI.stage = shaders[1].stageCI;
+		else computePipelineCI.stage = shaders[2].stageCI;
+		computePipelineCI.stage.pSpecializationInfo = &specInfo;
+
+		VkPipeline pipeline;
+		if (vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineCI, 0, &pipeline) != VK_SUCCESS)
+			throw std::runtime_error("Cannot create compute pipeline");
+		plan.pipelines.push_back(pipeline);
+		transformLength *= radix;
+	}
+}
+
+void SDFTFilter::destroyFFTPipelines(FFTPlan& plan)
+{
+	for (VkPipeline pipeline : plan.pipelines)
+		vkDestroyPipeline(context.device, pipeline, 0);
+	vkDestroyPipeline(context.device, plan.sharedPipeline, 0);
+	plan.pipelines.clear();
+	plan.sharedPipeline = VK_NULL_HANDLE;
+}
+
+// Bytes of the forward spectrogram downloaded per chunk
+VkDeviceSize SDFTFilter::getSpecBufferSize()
+{
+	int bins = props.real_fft ? props.spec_height / 2 + 1 : props.spec_height;
+	return sizeof(glm::vec2) * props.segment_width * bins;
+}
+
+// Turns the spec_height/2 transform of the packed real signal into the spec_height/2+1 non-redundant bins
+// Batched inputs are packed back to back, outputs outBatchStride apart (back to back by default)
+void SDFTFilter::recordRealSplit(VkCommandBuffer commandBuffer, VkDescriptorSet src, VkDescriptorSet dst, VkBuffer inBuffer, int columns,
+	int batch, int outBatchStride)
+{
+	if (columns == 0) columns = props.segment_width;
+	int half = props.spec_height / 2;
+	SDFTState state = {
+		.stageStride = 0,
+		.hop = 0,
+		.isWriteImg = 0,
+		.isInverse = 0,
+		.isShift = 0,
+		.specHeight = props.spec_height,
+		.inBatchStride = columns * half,
+		.outBatchStride = outBatchStride ? outBatchStride : columns * (half + 1)
+	};
+	VkBufferMemoryBarrier splitBarrier = {
+			   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			   .pNext = 0,
+			   .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+			   .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .buffer = inBuffer,
+			   .offset = 0,
+			   .size = VK_WHOLE_SIZE
+	};
+	std::vector< VkDescriptorSet> pipeIO = { src, dst, twiddleDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, rfftSplitPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)pipeIO.size(), pipeIO.data(), 0, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &splitBarrier, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, sdftPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SDFTState), &state);
+	vkCmdDispatch(commandBuffer, (half + 1 + 255) / 256, columns, batch);
+}
+
+// A radix-2 FFT column costs about 5*N*log2(N) flops, sliding it by hop samples about 10*N*hop.
+// The sliding pass also skips the per-stage round trips through memory, so ties go to it
+bool SDFTFilter::chooseRecursiveSDFT()
+{
+	if (props.sdft_engine == SDFT_FFT) return false;
+	if (props.sdft_engine == SDFT_RECURSIVE) return true;
+	if (props.sdft_engine != SDFT_AUTO)
+		throw std::runtime_error("Unknown SDFT engine");
+	int logHeight = 0;
+	while ((1 << (logHeight + 1)) <= props.spec_height) logHeight++;
+	return 2 * props.hop <= logHeight;
+}
+
+// FFT of the first column only, sdft_sliding.comp derives the others from it in place.
+// The output layout matches the FFT path: shifted columns, or the non-redundant bins of the real-input path
+void SDFTFilter::recordSlidingSDFT(VkCommandBuffer commandBuffer, Chunk& chunk, int batch)
+{
+	int bins = props.real_fft ? props.spec_height / 2 + 1 : props.spec_height;
+	// Batched chunks start hop * segment_width samples apart, their seeds land on the first column of each
+	int chunkStride = props.hop * props.segment_width;
+	if (props.real_fft) chunkStride /= 2;
+	SDFTState state = {
+		.stageStride = 0,
+		.hop = props.hop,
+		.isWriteImg = 0,
+		.isInverse = 0,
+		.isShift = props.real_fft ? 0 : 1,
+		.specHeight = props.spec_height,
+		.inBatchStride = chunkStride,
+		.outBatchStride = props.segment_width * bins
+	};
+	if (props.real_fft) {
+		recordSDFT(commandBuffer, realFFT, chunk.srcDSetExt.first, chunk.dstSDFTDSet.first, chunk, chunk.signalRawExtBuffer.first, chunk.specRawBuffer.first, false, false,
+			1, 0, batch, chunkStride);
+		recordRealSplit(commandBuffer, chunk.dstSDFTDSet.first, chunk.dstSDFTFiltDSet.first, chunk.specRawBuffer.first, 1, batch, state.outBatchStride);
+	}
+	else {
+		recordSDFT(commandBuffer, fft, chunk.srcDSetExt.first, chunk.dstSDFTFiltDSet.first, chunk, chunk.signalRawExtBuffer.first, chunk.specFiltBuffer.first, false, true,
+			1, 0, batch, chunkStride, state.outBatchStride);
+	}
+	VkBufferMemoryBarrier seedBarrier = {
+			   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			   .pNext = 0,
+			   .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+			   .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .buffer = chunk.specFiltBuffer.first,
+			   .offset = 0,
+			   .size = VK_WHOLE_SIZE
+	};
+	std::vector< VkDescriptorSet> pipeIO = { chunk.srcDSetExt.first, chunk.dstSDFTFiltDSet.first, twiddleDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftSlidingPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)pipeIO.size(), pipeIO.data(), 0, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &seedBarrier, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, sdftPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SDFTState), &state);
+	vkCmdDispatch(commandBuffer, (bins + 255) / 256, 1, batch);
+}
+
+// filter_subgroup.comp needs subgroupAdd in compute shaders and subgroups of 8 to 128 invocations
+bool SDFTFilter::checkSubgroupReduce()
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(context.physicalDevice, &deviceProperties);
+	if (props.direct_reduce == REDUCE_TREE) return false;
+	if (deviceProperties.apiVersion < VK_API_VERSION_1_1) return false;
+
+	VkPhysicalDeviceSubgroupProperties subgroupProperties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+		.pNext = 0
+	};
+	VkPhysicalDeviceProperties2 deviceProperties2 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &subgroupProperties
+	};
+	vkGetPhysicalDeviceProperties2(context.physicalDevice, &deviceProperties2);
+	return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+		(subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT) &&
+		subgroupProperties.subgroupSize >= 8 && subgroupProperties.subgroupSize <= 128;
+}
+
+// Blocks of block_size output samples are correlated with every filter column crossfaded within the block.
+// The filters are split into partitions of block_size taps, so every transform is spec_height long
+void SDFTFilter::initOverlapSave()
+{
+	int signalLen = props.hop * props.segment_width + props.spec_height;
+	int blockSize = props.spec_height / 2;
+	ols = {
+		.signal_len = signalLen,
+		.hop = props.hop,
+		.spec_height = props.spec_height,
+		.segment_width = props.segment_width,
+		.block_size = blockSize,
+		.partitions = props.spec_height / blockSize,
+		.block_columns = 0,
+		.blocks = (signalLen + blockSize - 1) / blockSize
+	};
+	// Same column selection as filter.comp
+	int lastColumn = props.segment_width - 1;
+	for (int block = 0; block < ols.blocks; block++) {
+		int first = std::min(block * blockSize * lastColumn / signalLen, lastColumn);
+		int lastSample = std::min(block * blockSize + blockSize, signalLen) - 1;
+		int last = std::min(std::min(lastSample * lastColumn / signalLen, lastColumn) + 1, lastColumn);
+		ols.block_columns = std::max(ols.block_columns, last - first + 1);
+	}
+}
+
+int SDFTFilter::chooseFilterTileLen()
+{
+	int rows = std::max((props.spec_height + props.hop * props.segment_width) / SUMMATION_WIDTH, 1) * SUMMATION_WIDTH;
+	// Only the filter.comp + sum.comp tree uses the scratch, the other engines keep a token one
+	if (props.fir_engine != FIR_DIRECT || isSubgroupReduce)
+		return SUMMATION_WIDTH;
+	if (props.memory_budget == 0)
+		return rows;
+	// Two scratch buffers of spec_height / SUMMATION_SIZE partial sums per output sample
+	VkDeviceSize rowSize = 2 * getFilterTempElementSize() * props.spec_height / SUMMATION_SIZE;
+	VkDeviceSize budgetRows = props.memory_budget / rowSize / SUMMATION_WIDTH * SUMMATION_WIDTH;
+	return (int)std::min(std::max(budgetRows, (VkDeviceSize)SUMMATION_WIDTH), (VkDeviceSize)rows);
+}
+
+VkDeviceSize SDFTFilter::getFilterTempElementSize()
+{
+	// The half precision shaders keep the real part only
+	return isHalfStorage ? sizeof(uint16_t) : sizeof(glm::vec2);
+}
+
+void SDFTFilter::recordFilterTile(Chunk& chunk, int offset, int len)
+{
+	FIRState state = {
+		.signal_len = props.hop * props.segment_width + props.spec_height,
+		.hop = props.hop,
+		.spec_height = props.spec_height,
+		.tile_offset = offset
+	};
+	SUMState sumState = {
+		.stride = props.spec_height / SUMMATION_SIZE,
+		.out_stride = props.spec_height / SUMMATION_SIZE,
+		.spec_height = props.spec_height / SUMMATION_SIZE,
+		.signal_len = len,
+		.out_offset = 0
+	};
+	VkBufferMemoryBarrier filterBarrier = {
+		   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		   .pNext = 0,
+		   .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+		   .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+		   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		   .offset = 0,
+		   .size = VK_WHOLE_SIZE
+	};
+	// chunk.filterDSet.first, chunk.srcDSetExt.first, chunk.filteredDSet.first
+	int nStages = (int)log2(props.spec_height / SUMMATION_SIZE);
+	std::vector< VkDescriptorSet> descriptorsSrcTemp1 = { chunk.filterDSet.first, chunk.srcDSetExt.first, chunk.filterTemp1DSet.first };
+	std::vector< VkDescriptorSet> descriptorsTemp1Temp2 = { chunk.filterTemp1DSet.first, chunk.filterTemp2DSet.first };
+	std::vector< VkDescriptorSet> descriptorsTemp2Temp1 = { chunk.filterTemp2DSet.first, chunk.filterTemp1DSet.first };
+	std::vector< VkDescriptorSet> descriptorsTemp1Dst = { chunk.filterTemp1DSet.first, chunk.filteredDSet.first };
+	std::vector< VkDescriptorSet> descriptorsTemp2Dst = { chunk.filterTemp2DSet.first, chunk.filteredDSet.first };
+	if (offset > 0) {
+		// The previous tile's reduction still reads the scratch these products overwrite
+		vkCmdPipelineBarrier(chunk.cmdBuffFilter, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 0, nullptr);
+	}
+	vkCmdBindPipeline(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipeline);
+	vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipelineLayout, 0, (uint32_t)descriptorsSrcTemp1.size(), descriptorsSrcTemp1.data(), 0, 0);
+	vkCmdPushConstants(chunk.cmdBuffFilter, filterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FIRState), &state);
+	vkCmdDispatch(chunk.cmdBuffFilter, std::max(props.spec_height / SUMMATION_SIZE, 1), len / SUMMATION_WIDTH, 1);
+	filterBarrier.buffer = chunk.filterTemp1Buffer.first;
+	vkCmdPipelineBarrier(chunk.cmdBuffFilter, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &filterBarrier, 0, nullptr);
+
+	// Sum the multiplications
+	vkCmdBindPipeline(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipeline);
+	for (int stage = 0; stage < nStages - 1; stage++) {
+		sumState.stride = sumState.stride / 2;
+		if (stage % 2 == 0) {
+			vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp1Temp2.size(), descriptorsTemp1Temp2.data(), 0, 0);
+		}
+		else {
+			vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp2Temp1.size(), descriptorsTemp2Temp1.data(), 0, 0);
+		}
+		vkCmdPushConstants(chunk.cmdBuffFilter, sumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SUMState), &sumState);
+		vkCmdDispatch(chunk.cmdBuffFilter, std::max(sumState.stride / SUMMATION_SIZE, 1), len / SUMMATION_WIDTH, 1);
+		vkCmdPipelineBarrier(chunk.cmdBuffFilter, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &filterBarrier, 0, nullptr);
+		if (stage % 2 == 0) {
+			filterBarrier.buffer = chunk.filterTemp2Buffer.first;
+		}
+		else {
+			filterBarrier.buffer = chunk.filterTemp1Buffer.first;
+		}
+		vkCmdPipelineBarrier(chunk.cmdBuffFilter, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &filterBarrier, 0, nullptr);
+	}
+	if (nStages % 2 == 0) {
+		vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp2Dst.size(), descriptorsTemp2Dst.data(), 0, 0);
+	}
+	else {
+		vkCmdBindDescriptorSets(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumPipelineLayout, 0, (uint32_t)descriptorsTemp1Dst.size(), descriptorsTemp1Dst.data(), 0, 0);
+	}
+	sumState.stride = sumState.stride / 2; // Stride should be 1 here
+	sumState.out_stride = 1;
+	sumState.out_offset = offset;
+	if (isHalfStorage)
+		vkCmdBindPipeline(chunk.cmdBuffFilter, VK_PIPELINE_BIND_POINT_COMPUTE, sumLastPipeline);
+	vkCmdPushConstants(chunk.cmdBuffFilter, sumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SUMState), &sumState);
+	vkCmdDispatch(chunk.cmdBuffFilter, 1, len / SUMMATION_WIDTH, 1);
+}
+
+void SDFTFilter::recordOverlapSave(VkCommandBuffer commandBuffer, Chunk& chunk)
+{
+	int signalColumns = ols.blocks + ols.partitions - 1;
+	int filterColumns = ols.segment_width * ols.partitions;
+	int blockColumns = ols.blocks * ols.block_columns;
+	int groupsX = (props.spec_height + 255) / 256;
+	VkBufferMemoryBarrier olsBarriers[2];
+	for (VkBufferMemoryBarrier& barrier : olsBarriers) {
+		barrier = {
+			   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			   .pNext = 0,
+			   .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+			   .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .offset = 0,
+			   .size = VK_WHOLE_SIZE
+		};
+	}
+
+	// Zero the padding behind the extended signal, it enters the FFT of the last signal block
+	vkCmdFillBuffer(commandBuffer, chunk.signalRawExtBuffer.first, sizeof(glm::vec2) * (ols.signal_len + props.spec_height), VK_WHOLE_SIZE, 0);
+
+	// Split the filters into partitions and transform them
+	std::vector< VkDescriptorSet> packIO = { chunk.filterDSet.first, chunk.olsFilterPartsDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, olsPackPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, olsPipelineLayout, 0, (uint32_t)packIO.size(), packIO.data(), 0, 0);
+	vkCmdPushConstants(commandBuffer, olsPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(OLSState), &ols);
+	vkCmdDispatch(commandBuffer, groupsX, filterColumns, 1);
+	recordSDFT(commandBuffer, fft, chunk.olsFilterPartsDSet.first, chunk.olsFilterSpecDSet.first, chunk,
+		chunk.olsFilterPartsBuffer.first, chunk.olsFilterSpecBuffer.first, false, false, filterColumns, props.spec_height);
+
+	// Signal blocks overlap by spec_height - block_size
+	recordSDFT(commandBuffer, fft, chunk.srcDSetExt.first, chunk.olsSignalSpecDSet.first, chunk,
+		chunk.signalRawExtBuffer.first, chunk.olsSignalSpecBuffer.first, false, false, signalColumns, ols.block_size);
+
+	// Multiply-accumulate the partitions
+	olsBarriers[0].buffer = chunk.olsFilterSpecBuffer.first;
+	olsBarriers[1].buffer = chunk.olsSignalSpecBuffer.first;
+	std::vector< VkDescriptorSet> macIO = { chunk.olsSignalSpecDSet.first, chunk.olsFilterSpecDSet.first, chunk.olsProductDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, olsMacPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, olsPipelineLayout, 0, (uint32_t)macIO.size(), macIO.data(), 0, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 2, olsBarriers, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, olsPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(OLSState), &ols);
+	vkCmdDispatch(commandBuffer, groupsX, blockColumns, 1);
+
+	// Back to time domain, the signal spectra are not needed anymore
+	recordSDFT(commandBuffer, fft, chunk.olsProductDSet.first, chunk.olsSignalSpecDSet.first, chunk,
+		chunk.olsProductBuffer.first, chunk.olsSignalSpecBuffer.first, true, false, blockColumns);
+
+	// Crossfade the columns
+	std::vector< VkDescriptorSet> blendIO = { chunk.olsSignalSpecDSet.first, chunk.filteredDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, olsBlendPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, olsPipelineLayout, 0, (uint32_t)blendIO.size(), blendIO.data(), 0, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &olsBarriers[1], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, olsPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(OLSState), &ols);
+	vkCmdDispatch(commandBuffer, (ols.signal_len + 255) / 256, 1, 1);
+}
+
+// Analysis frames -> FFT -> mask -> inverse FFT -> weighted overlap-add into signalFilt
+void SDFTFilter::recordSTFTMask(VkCommandBuffer commandBuffer, Chunk& chunk)
+{
+	int groupsX = (props.spec_height + 255) / 256;
+	VkBufferMemoryBarrier stftBarriers[2];
+	for (VkBufferMemoryBarrier& barrier : stftBarriers) {
+		barrier = {
+			   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			   .pNext = 0,
+			   .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+			   .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			   .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			   .offset = 0,
+			   .size = VK_WHOLE_SIZE
+		};
+	}
+
+	std::vector< VkDescriptorSet> frameIO = { chunk.srcDSetExt.first, chunk.stftFramesDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stftFramePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stftPipelineLayout, 0, (uint32_t)frameIO.size(), frameIO.data(), 0, 0);
+	vkCmdPushConstants(commandBuffer, stftPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(STFTState), &stft);
+	vkCmdDispatch(commandBuffer, groupsX, stft.frames, 1);
+	recordSDFT(commandBuffer, fft, chunk.stftFramesDSet.first, chunk.stftSpecDSet.first, chunk,
+		chunk.stftFramesBuffer.first, chunk.stftSpecBuffer.first, false, false, stft.frames, props.spec_height);
+
+	stftBarriers[0].buffer = chunk.stftSpecBuffer.first;
+	stftBarriers[1].buffer = chunk.maskBuffer.first;
+	std::vector< VkDescriptorSet> maskIO = { chunk.stftSpecDSet.first, chunk.maskDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stftMaskPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stftPipelineLayout, 0, (uint32_t)maskIO.size(), maskIO.data(), 0, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 2, stftBarriers, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, stftPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(STFTState), &stft);
+	vkCmdDispatch(commandBuffer, groupsX, stft.frames, 1);
+	recordSDFT(commandBuffer, fft, chunk.stftSpecDSet.first, chunk.stftFramesDSet.first, chunk,
+		chunk.stftSpecBuffer.first, chunk.stftFramesBuffer.first, true, false, stft.frames);
+
+	stftBarriers[0].buffer = chunk.stftFramesBuffer.first;
+	std::vector< VkDescriptorSet> olaIO = { chunk.stftFramesDSet.first, chunk.filteredDSet.first };
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stftOlaPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stftPipelineLayout, 0, (uint32_t)olaIO.size(), olaIO.data(), 0, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, stftBarriers, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, stftPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(STFTState), &stft);
+	vkCmdDispatch(commandBuffer, (stft.signal_len + 255) / 256, 1, 1);
+}
 
 // In and out buffers should the ones bound to the src and dst descriptor sets
-void SDFTFilter::recordSDFT(VkCommandBuffer commandBuffer, VkDescriptorSet src, VkDescriptorSet dst, Chunk chunk, 
-	VkBuffer inBuffer, VkBuffer outBuffer, bool isInverse, bool isShift) 
+// columns and hop default to the chunk spectrogram width and the forward hop (spec_height for the inverse)
+// batch chunks go in one dispatch, inputs inBatchStride elements apart, outputs outBatchStride apart (back to back by default)
+void SDFTFilter::recordSDFT(VkCommandBuffer commandBuffer, const FFTPlan& plan, VkDescriptorSet src, VkDescriptorSet dst, Chunk chunk, 
+	VkBuffer inBuffer, VkBuffer outBuffer, bool isInverse, bool isShift, int columns, int hop, int batch, int inBatchStride, int outBatchStride) 
 {
 	SDFTState state = {
 		.stageStride = 4,
 		.hop = 10,
 		.isWriteImg = 0,
-		.isInverse = 0,
+		.isInverse = isInverse ? 1 : 0,
 		.isShift = 0,
-		.specHeight = props.spec_height
+		.specHeight = plan.height,
+		.inBatchStride = inBatchStride,
+		.outBatchStride = 0
 	};
-	int nStages = (int)log2(props.spec_height);
-	std::vector< VkDescriptorSet> pipeInput = { src, chunk.temp1DSet.first };
-	std::vector< VkDescriptorSet> pipeOutput = { chunk.temp1DSet.first, dst };
-	if (nStages % 2 == 1) {
-		pipeOutput = { chunk.temp2DSet.first, dst };
-	}
-	std::vector< VkDescriptorSet> temp1temp2 = { chunk.temp1DSet.first, chunk.temp2DSet.first };
-	std::vector< VkDescriptorSet> temp2temp1 = { chunk.temp2DSet.first, chunk.temp1DSet.first };
+	const std::vector<int>& stages = plan.stages;
+	int nStages = (int)stages.size();
+	// A half length plan reads the real signal packed two samples per element
+	int forwardHop = props.hop / (props.spec_height / plan.height);
+	int inHop = hop ? hop : (isInverse ? plan.height : forwardHop);
+	int nColumns = columns ? columns : props.segment_width;
+	// Intermediate stages keep the batch back to back in the temp buffers
+	int tempBatchStride = nColumns * plan.height;
+	if (outBatchStride == 0) outBatchStride = tempBatchStride;
+	VkDescriptorSet temps[2] = { chunk.temp1DSet.first, chunk.temp2DSet.first };
+	VkDescriptorSet twiddles = twiddleDSet.first;
+	VkBuffer tempBuffers[2] = { chunk.sdftTemp1Buffer.first, chunk.sdftTemp2Buffer.first };
 	VkBufferMemoryBarrier sdftBarrier = {
 			   .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
 			   .pNext = 0,
@@ -835,46 +2363,57 @@ void SDFTFilter::recordSDFT(VkCommandBuffer commandBuffer, VkDescriptorSet src,
 			   .offset = 0,
 			   .size = VK_WHOLE_SIZE
 	};
+	if (plan.isShared) {
+		// All stages in one dispatch, one workgroup per column
+		std::vector< VkDescriptorSet> pipeIO = { src, dst, twiddles };
+		state.hop = inHop;
+		if (isShift) state.isShift = 1;
+		state.isWriteImg = 1;
+		state.outBatchStride = outBatchStride;
+		sdftBarrier.buffer = inBuffer;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, plan.sharedPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)pipeIO.size(), pipeIO.data(), 0, 0);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &sdftBarrier, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, sdftPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SDFTState), &state);
+		vkCmdDispatch(commandBuffer, 1, nColumns, batch);
+		return;
+	}
+
+	// Length of the sub-transforms already merged by the previous stages
+	int transformLength = 1;
 	for (int stage = 0; stage < nStages; stage++) {
-		int stride = (int)pow(2, nStages - stage - 1);
-		state.stageStride = stride;
+		int radix = stages[stage];
+		state.stageStride = plan.height / (transformLength * radix);
+		// Stockham stages ping-pong between the temp buffers, the inverse is applied on every stage
+		std::vector< VkDescriptorSet> pipeIO = {
+			stage == 0 ? src : temps[(stage - 1) % 2],
+			stage == nStages - 1 ? dst : temps[stage % 2],
+			twiddles
+		};
 		if (stage == 0) {
-			if (!isInverse) state.hop = props.hop;
-			else state.hop = props.spec_height;
-			if (isInverse) state.isInverse = 1;
+			state.hop = inHop;
 			sdftBarrier.buffer = inBuffer;
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)pipeInput.size(), pipeInput.data(), 0, 0);
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-				VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &sdftBarrier, 0, nullptr);
 		}
-		else if (stage == nStages - 1) {
+		else {
+			state.hop = plan.height;
+			state.inBatchStride = tempBatchStride;
+			sdftBarrier.buffer = tempBuffers[(stage - 1) % 2];
+		}
+		state.outBatchStride = tempBatchStride;
+		if (stage == nStages - 1) {
 			state.isWriteImg = 1;
-			state.hop = props.spec_height;
-			if (isInverse) state.isInverse = 1;
+			state.outBatchStride = outBatchStride;
 			if (isShift) state.isShift = 1;
-			sdftBarrier.buffer = outBuffer;
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)pipeOutput.size(), pipeOutput.data(), 0, 0);
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-				VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &sdftBarrier, 0, nullptr);
-		}
-		else {
-			state.isShift = 0;
-			state.isInverse = 0;
-			state.hop = props.spec_height;
-			if (stage % 2 == 0) {
-				sdftBarrier.buffer = chunk.sdftTemp2Buffer.first;
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)temp2temp1.size(), temp2temp1.data(), 0, 0);
-				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-					VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &sdftBarrier, 0, nullptr);
-			}
-			else {
-				sdftBarrier.buffer = chunk.sdftTemp1Buffer.first;
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)temp1temp2.size(), temp1temp2.data(), 0, 0);
-				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-					VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &sdftBarrier, 0, nullptr);
-			}
 		}
+
+		int groupSize = radix == 2 ? 1024 : 256;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, plan.pipelines[stage]);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sdftPipelineLayout, 0, (uint32_t)pipeIO.size(), pipeIO.data(), 0, 0);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			VK_DEPENDENCY_BY_REGION_BIT, 0, nullptr, 1, &sdftBarrier, 0, nullptr);
 		vkCmdPushConstants(commandBuffer, sdftPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SDFTState), &state);
-		vkCmdDispatch(commandBuffer, std::max(props.spec_height / 1024, 1), props.segment_width, 1);
+		vkCmdDispatch(commandBuffer, std::max(plan.height / radix / groupSize, 1), nColumns, batch);
+		transformLength *= radix;
 	}
 }
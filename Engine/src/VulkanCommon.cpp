@@ -45,7 +45,7 @@ VulkanContext setupContext(std::vector<const char*>& extensions)
 		.applicationVersion = VK_MAKE_VERSION(0, 0, 1),
 		.pEngineName = "No Engine",
 		.engineVersion = VK_MAKE_VERSION(0, 0, 1),
-		.apiVersion = VK_API_VERSION_1_0,
+		.apiVersion = VK_API_VERSION_1_2,
 	};
 
 	VkInstanceCreateInfo instanceCI = {
@@ -162,17 +162,47 @@ VulkanContext setupContext(std::vector<const char*>& extensions)
 			.pNext = 0,
 			.flags = 0,
 			.queueFamilyIndex = (uint32_t)queueIdx,
-			.queueCount = 4,
+			.queueCount = std::min(4u, qFamilyProperties[queueIdx].queueCount),
 			.pQueuePriorities = priorities.data()
 		};
 		queueFamilyCIs.push_back(queueCI);
 	}
-	queueFamilyCIs.back().queueCount = 1;
+	context.sdftQueueCount = (int)std::min(4u, qFamilyProperties[context.sdftFamilyIdx].queueCount);
+	context.graphicsQueueCount = (int)std::min(4u, qFamilyProperties[context.graphicsFamilyIdx].queueCount);
+	// Up to two transfer queues, uploads and downloads of neighbouring chunks run side by side
+	context.transferQueueCount = std::min(transferQueuesCnt, 2);
+	queueFamilyCIs.back().queueCount = (uint32_t)context.transferQueueCount;
 	VkPhysicalDeviceFeatures deviceFeatures = {};
+	// The engine chains its chunk stages with timeline semaphores, core since Vulkan 1.2
+	// 16-bit storage buffers are optional, they back the half precision scratch of SDFTFilter
+	VkPhysicalDevice16BitStorageFeatures storage16Features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES,
+		.pNext = 0,
+		.storageBuffer16BitAccess = VK_FALSE,
+		.uniformAndStorageBuffer16BitAccess = VK_FALSE,
+		.storagePushConstant16 = VK_FALSE,
+		.storageInputOutput16 = VK_FALSE
+	};
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+		.pNext = &storage16Features,
+		.timelineSemaphore = VK_FALSE
+	};
+	VkPhysicalDeviceFeatures2 supportedFeatures = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &timelineFeatures
+	};
+	vkGetPhysicalDeviceFeatures2(context.physicalDevice, &supportedFeatures);
+	if (!timelineFeatures.timelineSemaphore)
+		throw std::runtime_error("Timeline semaphores are not supported");
+	context.isStorage16Bit = storage16Features.storageBuffer16BitAccess == VK_TRUE;
+	storage16Features.uniformAndStorageBuffer16BitAccess = VK_FALSE;
+	storage16Features.storagePushConstant16 = VK_FALSE;
+	storage16Features.storageInputOutput16 = VK_FALSE;
 	std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 	VkDeviceCreateInfo deviceCI = {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		.pNext = 0,
+		.pNext = &timelineFeatures,
 		.flags = 0,
 		.queueCreateInfoCount = (uint32_t)queueFamilyCIs.size(),
 		.pQueueCreateInfos = queueFamilyCIs.data(),
@@ -308,26 +338,12 @@ std::pair<VkBuffer, VkDeviceMemory> createBuffer(VkDevice device, VkPhysicalDevi
 		throw std::runtime_error("Cannot create buffer");
 
 	VkMemoryRequirements memoryRequirements;
-	VkPhysicalDeviceMemoryProperties memoryProperties;
 	vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-	uint32_t memoryTypeIdx = (uint32_t)-1;
-	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
-		if ((memoryRequirements.memoryTypeBits & (i << i)) &&
-			((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
-			memoryTypeIdx = i;
-			break;
-		}
-	}
-	std::cout << "Buffer memory " << (memoryTypeIdx == (uint32_t)-1 ? "NOT supported" : "supported") << std::endl;
-	if (memoryTypeIdx == (uint32_t)-1)
-		throw std::runtime_error("Memory type is not suppotred");
-
 	VkMemoryAllocateInfo memoryAI = {
 		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
 		.pNext = 0,
 		.allocationSize = memoryRequirements.size,
-		.memoryTypeIndex = memoryTypeIdx
+		.memoryTypeIndex = findMemoryType(physicalDevice, memoryRequirements.memoryTypeBits, properties)
 	};
 
 	if (vkAllocateMemory(device, &memoryAI, 0, &memory) != VK_SUCCESS)
@@ -337,6 +353,202 @@ std::pair<VkBuffer, VkDeviceMemory> createBuffer(VkDevice device, VkPhysicalDevi
 	return { buffer, memory };
 }
 
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
+{
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((memoryTypeBits & (1u << i)) &&
+			((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties))
+			return i;
+	}
+	throw std::runtime_error("Memory type is not suppotred");
+}
+
+// Largest heap behind a device local, host visible and coherent memory type, 0 when there is none.
+// Integrated and software devices report their whole memory, discrete ones 256 MB unless resizable BAR is on
+VkDeviceSize getHostVisibleDeviceHeapSize(VkPhysicalDevice physicalDevice)
+{
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	VkDeviceSize heapSize = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			heapSize = std::max(heapSize, memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size);
+	}
+	return heapSize;
+}
+
+void MemoryPool::init(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize)
+{
+	this->device = device;
+	this->physicalDevice = physicalDevice;
+	this->blockSize = blockSize;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+}
+
+// First fit, the alignment gap in front stays free
+bool MemoryPool::allocate(Block& block, VkDeviceSize size, VkDeviceSize alignment, Range& range)
+{
+	for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); it++) {
+		VkDeviceSize offset = (it->offset + alignment - 1) / alignment * alignment;
+		if (offset + size > it->offset + it->size)
+			continue;
+		Range tail = { offset + size, it->offset + it->size - offset - size };
+		auto next = std::next(it);
+		if (offset > it->offset)
+			it->size = offset - it->offset;
+		else
+			block.freeRanges.erase(it);
+		if (tail.size > 0)
+			block.freeRanges.insert(next, tail);
+		range = { offset, size };
+		block.allocations++;
+		return true;
+	}
+	return false;
+}
+
+std::pair<VkBuffer, VkDeviceMemory> MemoryPool::createBuffer(std::vector<uint32_t> queueFamilyIndices, VkDeviceSize size,
+	VkMemoryPropertyFlags properties, VkBufferUsageFlags usage)
+{
+	VkBuffer buffer;
+	VkSharingMode sharingMode = queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	VkBufferCreateInfo bufferCI = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = 0,
+		.flags = 0,
+		.size = size,
+		.usage = usage,
+		.sharingMode = sharingMode,
+		.queueFamilyIndexCount = (uint32_t)queueFamilyIndices.size(),
+		.pQueueFamilyIndices = queueFamilyIndices.data()
+	};
+	if (vkCreateBuffer(device, &bufferCI, 0, &buffer) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create buffer");
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+	uint32_t memoryTypeIdx = findMemoryType(physicalDevice, memoryRequirements.memoryTypeBits, properties);
+
+	Allocation allocation = { nullptr, { 0, 0 } };
+	for (Block& block : blocks) {
+		if (block.memoryTypeIdx == memoryTypeIdx &&
+			allocate(block, memoryRequirements.size, memoryRequirements.alignment, allocation.range)) {
+			allocation.block = &block;
+			break;
+		}
+	}
+	if (!allocation.block) {
+		VkMemoryAllocateInfo memoryAI = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = 0,
+			.allocationSize = std::max(blockSize, memoryRequirements.size),
+			.memoryTypeIndex = memoryTypeIdx
+		};
+		Block block = {
+			.memory = VK_NULL_HANDLE,
+			.size = memoryAI.allocationSize,
+			.memoryTypeIdx = memoryTypeIdx,
+			.mapped = nullptr,
+			.freeRanges = { { 0, memoryAI.allocationSize } },
+			.allocations = 0
+		};
+		if (vkAllocateMemory(device, &memoryAI, 0, &block.memory) != VK_SUCCESS)
+			throw std::runtime_error("Cannot allocate memory for buffer");
+		// Later buffers of the type share the block whatever they ask for, so every host visible block is mapped
+		if ((memoryProperties.memoryTypes[memoryTypeIdx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+			vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS)
+			throw std::runtime_error("Cannot map buffer memory");
+		blocks.push_back(block);
+		allocation.block = &blocks.back();
+		allocate(*allocation.block, memoryRequirements.size, memoryRequirements.alignment, allocation.range);
+	}
+	vkBindBufferMemory(device, buffer, allocation.block->memory, allocation.range.offset);
+	allocations[buffer] = allocation;
+	return { buffer, allocation.block->memory };
+}
+
+void MemoryPool::destroyBuffer(std::pair<VkBuffer, VkDeviceMemory>& buffer)
+{
+	auto found = allocations.find(buffer.first);
+	if (found == allocations.end())
+		return;
+	vkDestroyBuffer(device, buffer.first, 0);
+	Block& block = *found->second.block;
+	Range range = found->second.range;
+	allocations.erase(found);
+	block.allocations--;
+
+	auto next = block.freeRanges.begin();
+	while (next != block.freeRanges.end() && next->offset < range.offset)
+		next++;
+	auto it = block.freeRanges.insert(next, range);
+	if (next != block.freeRanges.end() && it->offset + it->size == next->offset) {
+		it->size += next->size;
+		block.freeRanges.erase(next);
+	}
+	if (it != block.freeRanges.begin()) {
+		auto prev = std::prev(it);
+		if (prev->offset + prev->size == it->offset) {
+			prev->size += it->size;
+			block.freeRanges.erase(it);
+		}
+	}
+	buffer = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+}
+
+void* MemoryPool::map(VkBuffer buffer)
+{
+	Allocation& allocation = allocations.at(buffer);
+	if (!allocation.block->mapped)
+		throw std::runtime_error("Buffer memory is not host visible");
+	return (char*)allocation.block->mapped + allocation.range.offset;
+}
+
+void MemoryPool::trim()
+{
+	for (auto it = blocks.begin(); it != blocks.end();) {
+		if (it->allocations == 0) {
+			vkFreeMemory(device, it->memory, 0);		// Implicitly unmapped
+			it = blocks.erase(it);
+		}
+		else it++;
+	}
+}
+
+void MemoryPool::destroy()
+{
+	for (auto& allocation : allocations)
+		vkDestroyBuffer(device, allocation.first, 0);
+	allocations.clear();
+	for (Block& block : blocks)
+		vkFreeMemory(device, block.memory, 0);
+	blocks.clear();
+}
+
+bool MemoryPool::isFragmented()
+{
+	std::map<uint32_t, VkDeviceSize> freeSizes;
+	for (Block& block : blocks) {
+		if (block.allocations == 0)
+			continue;
+		for (Range& range : block.freeRanges)
+			freeSizes[block.memoryTypeIdx] += range.size;
+	}
+	for (auto& [memoryTypeIdx, freeSize] : freeSizes) {
+		if (freeSize >= blockSize)
+			return true;
+	}
+	return false;
+}
+
+size_t MemoryPool::getBlockCount()
+{
+	return blocks.size();
+}
+
 std::pair<VkImage, VkDeviceMemory> createImage(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex,
 	uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, 
 	VkImageUsageFlags usage, VkMemoryPropertyFlags properties)
@@ -365,21 +577,11 @@ std::pair<VkImage, VkDeviceMemory> createImage(VkDevice device, VkPhysicalDevice
 	VkMemoryRequirements requirements;
 	vkGetImageMemoryRequirements(device, image, &requirements);
 
-	VkPhysicalDeviceMemoryProperties memoryProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-	uint32_t memoryTypeIdx = (uint32_t)-1;
-	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
-		if ((requirements.memoryTypeBits & (i << i)) &&
-			((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)) {
-			memoryTypeIdx = i;
-			break;
-		}
-	}
 	VkMemoryAllocateInfo memoryAI = {
 		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
 		.pNext = 0,
 		.allocationSize = requirements.size,
-		.memoryTypeIndex = memoryTypeIdx
+		.memoryTypeIndex = findMemoryType(physicalDevice, requirements.memoryTypeBits, properties)
 	};
 	if (vkAllocateMemory(device, &memoryAI, 0, &memory) != VK_SUCCESS)
 		throw std::runtime_error("Cannot allocate image memory");
@@ -388,33 +590,89 @@ std::pair<VkImage, VkDeviceMemory> createImage(VkDevice device, VkPhysicalDevice
 	return { image, memory };
 }
 
-void createDescriptorSet(VkDevice device, std::vector<Binding> bindingsIn, std::vector<VkDescriptorSet>& descriptorSets, 
-	VkDescriptorPool *descriptorPool, VkDescriptorSetLayout* descriptorSetLayout)
+VkDescriptorSetLayout createDescriptorSetLayout(VkDevice device, std::vector<Binding> bindingsIn)
 {
 	uint32_t bindingIdx = 0;
-	if (*descriptorSetLayout == 0) {
-		// Create descriptor set layout
-		std::vector<VkDescriptorSetLayoutBinding> bindings;
-		for (Binding b : bindingsIn) {
-			bindings.push_back({
-				.binding = bindingIdx++,
-				.descriptorType = b.type,
-				.descriptorCount = 1,
-				.stageFlags = b.stageFlags,
-				.pImmutableSamplers = 0
-				});
-		};
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	for (Binding b : bindingsIn) {
+		bindings.push_back({
+			.binding = bindingIdx++,
+			.descriptorType = b.type,
+			.descriptorCount = 1,
+			.stageFlags = b.stageFlags,
+			.pImmutableSamplers = 0
+			});
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutCI = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = 0,
+		.flags = 0,
+		.bindingCount = (uint32_t)bindings.size(),
+		.pBindings = bindings.data()
+	};
+	VkDescriptorSetLayout descriptorSetLayout;
+	if (vkCreateDescriptorSetLayout(device, &layoutCI, 0, &descriptorSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create descriptor set layout");
+	return descriptorSetLayout;
+}
 
-		VkDescriptorSetLayoutCreateInfo layoutCI = {
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+// Points binding i of the set at bindingsIn[i]
+static void writeDescriptorSet(VkDevice device, std::vector<Binding>& bindingsIn, VkDescriptorSet descriptorSet)
+{
+	std::vector< VkWriteDescriptorSet> bufferWrites;
+	uint32_t bindingIdx = 0;
+	std::vector<VkDescriptorBufferInfo> bufferInfos;
+	std::vector<VkDescriptorImageInfo> imageInfos;
+	bufferInfos.reserve(bindingsIn.size());  // Reserve all values not to mess up the pointers
+	imageInfos.reserve(bindingsIn.size());
+	for (Binding b : bindingsIn) {
+		VkWriteDescriptorSet writeDescriptorSet = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 			.pNext = 0,
-			.flags = 0,
-			.bindingCount = (uint32_t)bindings.size(),
-			.pBindings = bindings.data()
+			.dstSet = descriptorSet,
+			.dstBinding = bindingIdx++,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = b.type,
+			.pImageInfo = 0,
+			.pBufferInfo = 0
 		};
-		if (vkCreateDescriptorSetLayout(device, &layoutCI, 0, descriptorSetLayout) != VK_SUCCESS)
-			throw std::runtime_error("Cannot create descriptor set layout");
-	}
+		if (b.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+			
+			bufferInfos.push_back({
+				.buffer = b.buffer.data,
+				.offset = 0,
+				.range = VK_WHOLE_SIZE
+				});
+			writeDescriptorSet.pBufferInfo = &(bufferInfos[bufferInfos.size() - 1]);
+		}
+		else if (b.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+			imageInfos.push_back({
+				.sampler = b.image.sampler,
+				.imageView = b.image.view,
+				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+				});
+			writeDescriptorSet.pImageInfo = &(imageInfos[imageInfos.size() - 1]);
+		}
+		else if (b.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) {
+			imageInfos.push_back({
+				.sampler = b.image.sampler,
+				.imageView = b.image.view,
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL
+				});
+			writeDescriptorSet.pImageInfo = &(imageInfos[imageInfos.size() - 1]);
+		}
+		bufferWrites.push_back(writeDescriptorSet);
+	};
+	vkUpdateDescriptorSets(device, (uint32_t)bufferWrites.size(), bufferWrites.data(), 0, 0);
+}
+
+void createDescriptorSet(VkDevice device, std::vector<Binding> bindingsIn, std::vector<VkDescriptorSet>& descriptorSets, 
+	VkDescriptorPool *descriptorPool, VkDescriptorSetLayout* descriptorSetLayout)
+{
+	if (*descriptorSetLayout == 0)
+		*descriptorSetLayout = createDescriptorSetLayout(device, bindingsIn);
 	// Create descriptor pool
 	std::vector<VkDescriptorPoolSize> poolSizes;
 	for (Binding b : bindingsIn) {
@@ -443,58 +701,10 @@ void createDescriptorSet(VkDevice device, std::vector<Binding> bindingsIn, std::
 		.descriptorSetCount = 1,
 		.pSetLayouts = descriptorSetLayout
 	};
-	int i = 0;
 	for (VkDescriptorSet& descriptorSet : descriptorSets) {
 		if (vkAllocateDescriptorSets(device, &setAI, &descriptorSet) != VK_SUCCESS)
 			throw std::runtime_error("Cannot allocate descriptor set");
-
-		std::vector< VkWriteDescriptorSet> bufferWrites;
-		bindingIdx = 0;
-		std::vector<VkDescriptorBufferInfo> bufferInfos;
-		std::vector<VkDescriptorImageInfo> imageInfos;
-		bufferInfos.reserve(4);  // Reserve some values not to mess up the pointers
-		imageInfos.reserve(4);
-		for (Binding b : bindingsIn) {
-			VkWriteDescriptorSet writeDescriptorSet = {
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.pNext = 0,
-				.dstSet = descriptorSet,
-				.dstBinding = bindingIdx++,
-				.dstArrayElement = 0,
-				.descriptorCount = 1,
-				.descriptorType = b.type,
-				.pImageInfo = 0,
-				.pBufferInfo = 0
-			};
-			if (b.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
-				
-				bufferInfos.push_back({
-					.buffer = b.buffer.data,
-					.offset = 0,
-					.range = VK_WHOLE_SIZE
-					});
-				writeDescriptorSet.pBufferInfo = &(bufferInfos[bufferInfos.size() - 1]);
-			}
-			else if (b.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
-				imageInfos.push_back({
-					.sampler = b.image.sampler,
-					.imageView = b.image.view,
-					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-					});
-				writeDescriptorSet.pImageInfo = &(imageInfos[imageInfos.size() - 1]);
-			}
-			else if (b.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) {
-				imageInfos.push_back({
-					.sampler = b.image.sampler,
-					.imageView = b.image.view,
-					.imageLayout = VK_IMAGE_LAYOUT_GENERAL
-					});
-				writeDescriptorSet.pImageInfo = &(imageInfos[imageInfos.size() - 1]);
-			}
-			bufferWrites.push_back(writeDescriptorSet);
-		};
-		vkUpdateDescriptorSets(device, (uint32_t)bufferWrites.size(), bufferWrites.data(), 0, 0);
-		i++;
+		writeDescriptorSet(device, bindingsIn, descriptorSet);
 	}
 }
 
@@ -521,3 +731,73 @@ Binding createStorageImage(VulkanContext context, uint32_t width, uint32_t heigh
 
 	return result;
 }
+
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPool)
+{
+	this->device = device;
+	this->setsPerPool = setsPerPool;
+}
+
+VkDescriptorPool DescriptorAllocator::addPool()
+{
+	// Sets of up to DESCRIPTOR_POOL_BINDINGS storage buffers each
+	VkDescriptorPoolSize poolSize = {
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = setsPerPool * DESCRIPTOR_POOL_BINDINGS
+	};
+	VkDescriptorPoolCreateInfo poolCI = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = 0,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+		.maxSets = setsPerPool,
+		.poolSizeCount = 1,
+		.pPoolSizes = &poolSize
+	};
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(device, &poolCI, 0, &pool) != VK_SUCCESS)
+		throw std::runtime_error("Cannot create descriptor pool");
+	pools.push_back(pool);
+	return pool;
+}
+
+std::pair<VkDescriptorSet, VkDescriptorPool> DescriptorAllocator::allocate(std::vector<Binding> bindings, VkDescriptorSetLayout setLayout)
+{
+	if (bindings.size() > DESCRIPTOR_POOL_BINDINGS)
+		throw std::runtime_error("Too many bindings for a descriptor heap set");
+	VkDescriptorSetAllocateInfo setAI = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = 0,
+		.descriptorPool = VK_NULL_HANDLE,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &setLayout
+	};
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	// Full pools fail the allocation, the newest one is the likeliest to have room
+	for (auto pool = pools.rbegin(); pool != pools.rend() && descriptorSet == VK_NULL_HANDLE; pool++) {
+		setAI.descriptorPool = *pool;
+		if (vkAllocateDescriptorSets(device, &setAI, &descriptorSet) != VK_SUCCESS)
+			descriptorSet = VK_NULL_HANDLE;
+	}
+	if (descriptorSet == VK_NULL_HANDLE) {
+		setAI.descriptorPool = addPool();
+		if (vkAllocateDescriptorSets(device, &setAI, &descriptorSet) != VK_SUCCESS)
+			throw std::runtime_error("Cannot allocate descriptor set");
+	}
+	writeDescriptorSet(device, bindings, descriptorSet);
+	return { descriptorSet, setAI.descriptorPool };
+}
+
+void DescriptorAllocator::free(std::pair<VkDescriptorSet, VkDescriptorPool>& descriptorSet)
+{
+	if (descriptorSet.first == VK_NULL_HANDLE)
+		return;
+	vkFreeDescriptorSets(device, descriptorSet.second, 1, &descriptorSet.first);
+	descriptorSet = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+}
+
+void DescriptorAllocator::destroy()
+{
+	for (VkDescriptorPool pool : pools)
+		vkDestroyDescriptorPool(device, pool, 0);
+	pools.clear();
+}
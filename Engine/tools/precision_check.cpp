@@ -0,0 +1,121 @@
+// Runs the FIR_DIRECT filter.comp + sum.comp tree with fp32 and fp16 storage on one fixed signal and mask,
+// reports the fp16 error against the fp32 output and the time of both.
+// Exits with 1 when the RMS error is above CHECK_MAX_ERROR_DB or 16-bit storage is not supported.
+// Run it from the outputs directory, the filter loads Shaders/*.spv relative to it
+#include <SDFTFilter.h>
+#include <VulkanCommon.h>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <iostream>
+
+#define CHECK_SPEC_HEIGHT 1024
+#define CHECK_SEGMENT_WIDTH 32
+#define CHECK_HOP 128
+#define CHECK_CHUNKS 16
+#define CHECK_RUNS 10
+// RMS error against the RMS of the fp32 output. Half floats round to 11 bits, about -66 dB per value,
+// the margin covers the roundings of the filters and of every tree stage
+#define CHECK_MAX_ERROR_DB -50.0
+
+static SDFTProps getProps(int storagePrecision)
+{
+	return {
+		.spec_height = CHECK_SPEC_HEIGHT,
+		.segment_width = CHECK_SEGMENT_WIDTH,
+		.signal_length = 1024,
+		.hop = CHECK_HOP,
+		.hostMaskHeight = CHECK_SPEC_HEIGHT,
+		.hostMaskWidth = CHECK_SEGMENT_WIDTH,
+		.fft_radix = 8,
+		.real_fft = 1,
+		.fir_engine = FIR_DIRECT,
+		.filter_tolerance = 0.0f,
+		.process_mode = PROCESS_FIR,
+		.sdft_engine = SDFT_AUTO,
+		.ring_size = 0,
+		.batch_size = 1,
+		.memory_placement = MEMORY_AUTO,
+		.storage_precision = storagePrecision,
+		.memory_budget = 0,
+		.direct_reduce = REDUCE_TREE			// The only reduction keeping partial sums, subgroup devices would skip them
+	};
+}
+
+// Returns milliseconds per processSignal, the output of the last run is left in signalOut
+static double run(VulkanContext& context, int storagePrecision, std::vector<int>& mask, int maskColumns,
+	const std::vector<float>& signalIn, std::vector<float>& signalOut)
+{
+	SDFTFilter* filter = new SDFTFilter(context, getProps(storagePrecision));
+	filter->processSignal(mask.data(), maskColumns, signalIn, signalOut);		// Warm up
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < CHECK_RUNS; i++)
+		filter->processSignal(mask.data(), maskColumns, signalIn, signalOut);
+	auto end = std::chrono::high_resolution_clock::now();
+	delete filter;
+	return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0 / CHECK_RUNS;
+}
+
+int main()
+{
+	std::vector<const char*> extensions = {};
+	VulkanContext context = setupContext(extensions);
+	if (!context.isStorage16Bit) {
+		std::cout << "16-bit storage buffers are not supported, nothing to compare" << std::endl;
+		destroyContext(context);
+		return 1;
+	}
+
+	// Three tones over deterministic noise
+	int chunkLen = CHECK_HOP * CHECK_SEGMENT_WIDTH + CHECK_SPEC_HEIGHT;
+	std::vector<float> signalIn((size_t)chunkLen * CHECK_CHUNKS);
+	uint32_t seed = 1;
+	for (size_t n = 0; n < signalIn.size(); n++) {
+		seed = seed * 1664525u + 1013904223u;
+		float noise = (float)(seed >> 8) / (1 << 24) - 0.5f;
+		signalIn[n] = 0.5f * std::sin(2 * std::numbers::pi_v<float> * 0.01f * n)
+			+ 0.3f * std::sin(2 * std::numbers::pi_v<float> * 0.13f * n)
+			+ 0.1f * std::sin(2 * std::numbers::pi_v<float> * 0.37f * n)
+			+ 0.05f * noise;
+	}
+	// Low pass with a cutoff sweeping over the columns and a half gain band above it
+	int maskColumns = CHECK_CHUNKS * CHECK_SEGMENT_WIDTH;
+	std::vector<int> mask((size_t)maskColumns * CHECK_SPEC_HEIGHT);
+	for (int col = 0; col < maskColumns; col++) {
+		int cutoff = CHECK_SPEC_HEIGHT / 8 + (CHECK_SPEC_HEIGHT / 4) * col / maskColumns;
+		for (int row = 0; row < CHECK_SPEC_HEIGHT; row++) {
+			int bin = std::min(row, CHECK_SPEC_HEIGHT - row);		// Mirrored negative frequencies
+			mask[(size_t)col * CHECK_SPEC_HEIGHT + row] = bin < cutoff ? 255 : bin < 2 * cutoff ? 128 : 0;
+		}
+	}
+
+	std::vector<float> reference, halfOut;
+	double fp32Time = run(context, STORAGE_FP32, mask, maskColumns, signalIn, reference);
+	double fp16Time = run(context, STORAGE_FP16, mask, maskColumns, signalIn, halfOut);
+
+	double maxError = 0, errorSum = 0, referenceSum = 0;
+	for (size_t n = 0; n < reference.size(); n++) {
+		double error = std::abs((double)halfOut[n] - reference[n]);
+		maxError = std::max(maxError, error);
+		errorSum += error * error;
+		referenceSum += (double)reference[n] * reference[n];
+	}
+	double rmsError = std::sqrt(errorSum / reference.size());
+	double rmsReference = std::sqrt(referenceSum / reference.size());
+	std::cout << "Samples: " << reference.size() << ", runs: " << CHECK_RUNS << std::endl;
+	std::cout << "fp32: " << fp32Time << " ms" << std::endl;
+	std::cout << "fp16: " << fp16Time << " ms" << std::endl;
+	double errorDB = 20 * std::log10(std::max(rmsError, 1e-12) / rmsReference);
+	std::cout << "Max error: " << maxError << ", RMS error: " << rmsError << " (" << errorDB << " dB against the output)" << std::endl;
+	destroyContext(context);
+	if (maxError == 0) {
+		std::cout << "FAIL: identical outputs, the half precision shaders did not run" << std::endl;
+		return 1;
+	}
+	if (errorDB > CHECK_MAX_ERROR_DB) {
+		std::cout << "FAIL: fp16 error above " << CHECK_MAX_ERROR_DB << " dB" << std::endl;
+		return 1;
+	}
+	std::cout << "PASS: fp16 error within " << CHECK_MAX_ERROR_DB << " dB" << std::endl;
+	return 0;
+}
@@ -15,6 +15,15 @@ private:
 	std::vector<float> signalFilt;
 	int hop = 128;
 	int specHeight = 1024;
+
+	// Writes the chunk straight into the mapped upload memory, zero padded to the chunk length
+	void stageSignal(const float* samples, size_t count) {
+		float* staged = SDFTFilterStageUpdate();
+		for (size_t i = 0; i < signalIn.size(); i++) {
+			staged[i * 2] = i < count ? samples[i] : 0.0f;
+			staged[i * 2 + 1] = 0.0f;
+		}
+	}
 public:
 	Spectralysis(int hop, int specHeight) : hop(hop), specHeight(specHeight) {
 		SDFTFilterInit(specHeight, SEGMENT_WIDTH, hop, specHeight);
@@ -67,8 +76,6 @@ public:
 		}
 		*/
 		
-		memcpy(mask.data(), ptr_mask, mask.size() * sizeof(int));
-		memcpy(signalIn.data(), ptr_in, signalIn.size() * sizeof(float));
 		/*
 		for (int i = 0; i < mask.size(); i++) {
 			std::cout << mask[i] << ' ';
@@ -82,7 +89,8 @@ public:
 		std::cout << std::endl << signalIn.size() << std::endl;
 		*/
 		auto start = std::chrono::high_resolution_clock::now();
-		SDFTFilterUpdate(mask.data(), signalIn, signalFilt);
+		stageSignal(ptr_in, (size_t)info_in.size);
+		SDFTFilterWait(SDFTFilterCommitUpdate(ptr_mask), signalFilt);
 		auto end = std::chrono::high_resolution_clock::now();
 		std::cout << "Processing executed: " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << std::endl;
 		py::array output = py::cast(signalFilt);
@@ -99,6 +107,20 @@ public:
 		return output;
 	}
 	
+	// process followed by sdft of the filtered signal without bringing it back in between
+	py::tuple process_analyze(
+		const py::array_t<float, py::array::c_style | py::array::forcecast>& in,
+		const py::array_t<int, py::array::c_style | py::array::forcecast>& in_mask
+	) {
+		memcpy(mask.data(), in_mask.data(), mask.size() * sizeof(int));
+		memcpy(signalIn.data(), in.data(), signalIn.size() * sizeof(float));
+		auto start = std::chrono::high_resolution_clock::now();
+		SDFTFilterUpdateAndAnalyze(mask.data(), signalIn, signalFilt, specFilt);
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << "Processing and SDFT executed: " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << std::endl;
+		return py::make_tuple(py::cast(signalFilt), py::cast(specFilt));
+	}
+
 	py::array sdft(
 		const py::array_t<float, py::array::c_style | py::array::forcecast>& in
 	) {
@@ -134,6 +156,99 @@ public:
 		return output;
 	}
 	
+	// Filter truncation report of the last process call
+	float filter_error() {
+		return SDFTFilterGetError();
+	}
+
+	int filter_taps() {
+		return SDFTFilterGetTaps();
+	}
+
+	// 0 - FIR filtering, 1 - STFT masking
+	void set_mode(int mode) {
+		SDFTFilterSetMode(mode);
+	}
+
+	// Queues a chunk without waiting, the ticket is passed to poll and wait
+	uint64_t submit(
+		const py::array_t<float, py::array::c_style | py::array::forcecast>& in,
+		const py::array_t<int, py::array::c_style | py::array::forcecast>& in_mask
+	) {
+		stageSignal(in.data(), (size_t)in.size());
+		return SDFTFilterCommitUpdate(const_cast<int*>(in_mask.data()));
+	}
+
+	bool poll(uint64_t ticket) {
+		return SDFTFilterPoll(ticket);
+	}
+
+	py::array wait(uint64_t ticket) {
+		SDFTFilterWait(ticket, signalFilt);
+		return py::cast(signalFilt);
+	}
+
+	// Filters the whole unpadded signal, the mask holds spec_height pixels per column for
+	// SEGMENT_WIDTH * chunk_count(len(signal)) columns
+	py::array process_signal(
+		const py::array_t<float, py::array::c_style | py::array::forcecast>& in,
+		const py::array_t<int, py::array::c_style | py::array::forcecast>& in_mask
+	) {
+		std::vector<float> signal(in.data(), in.data() + in.size());
+		std::vector<float> signalOut;
+		int maskColumns = (int)(in_mask.size() / specHeight);
+		SDFTFilterProcessSignal(const_cast<int*>(in_mask.data()), maskColumns, signal, signalOut);
+		return py::cast(signalOut);
+	}
+
+	int chunk_count(int signalLength) {
+		return SDFTFilterGetChunkCount(signalLength);
+	}
+
+	// Keeps the whole unpadded signal on the GPU, the *_at calls filter its chunks by index
+	void load_signal(const py::array_t<float, py::array::c_style | py::array::forcecast>& in) {
+		std::vector<float> signal(in.data(), in.data() + in.size());
+		SDFTFilterLoadSignal(signal);
+	}
+
+	// load_signal of raw wav samples, int16 ones are uploaded as they are and widened on the GPU
+	void load_pcm(const py::array& in, bool normalize) {
+		if (in.dtype().is(py::dtype::of<int16_t>())) {
+			py::array_t<int16_t, py::array::c_style | py::array::forcecast> samples(in);
+			SDFTFilterLoadSignalInt16(samples.data(), samples.size(), normalize);
+		}
+		else {
+			py::array_t<float, py::array::c_style | py::array::forcecast> samples(in);
+			SDFTFilterLoadSignalFloat(samples.data(), samples.size(), normalize);
+		}
+	}
+
+	py::array process_at(int chunk, const py::array_t<int, py::array::c_style | py::array::forcecast>& in_mask) {
+		memcpy(mask.data(), in_mask.data(), mask.size() * sizeof(int));
+		SDFTFilterUpdateAt(mask.data(), chunk, signalFilt);
+		return py::cast(signalFilt);
+	}
+
+	py::tuple process_analyze_at(int chunk, const py::array_t<int, py::array::c_style | py::array::forcecast>& in_mask) {
+		memcpy(mask.data(), in_mask.data(), mask.size() * sizeof(int));
+		auto start = std::chrono::high_resolution_clock::now();
+		SDFTFilterUpdateAndAnalyzeAt(mask.data(), chunk, signalFilt, specFilt);
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << "Processing and SDFT executed: " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << std::endl;
+		return py::make_tuple(py::cast(signalFilt), py::cast(specFilt));
+	}
+
+	// Magnitudes of the whole unpadded signal, one row of spec_height per column hop samples apart
+	py::array spectrogram(
+		const py::array_t<float, py::array::c_style | py::array::forcecast>& in
+	) {
+		std::vector<float> signal(in.data(), in.data() + in.size());
+		int columns = SDFTFilterGetSpectrogramColumns((int)signal.size());
+		py::array_t<float> output({ columns, specHeight });
+		SDFTFilterComputeSpectrogram(signal, output.mutable_data());
+		return output;
+	}
+	
 	std::vector<int> getsize() {
 		std::vector<int> result = {
 			hop * SEGMENT_WIDTH + 2 * specHeight,
@@ -150,7 +265,21 @@ void test_func(py::module &m) {
     py::class_<Spectralysis>(m, "Spectralysis")
     .def(py::init<int, int>(), py::arg("hop"), py::arg("spec_height"))
     .def("process", &Spectralysis::process)
+    .def("process_analyze", &Spectralysis::process_analyze)
     .def("sdft", &Spectralysis::sdft)
+    .def("filter_error", &Spectralysis::filter_error)
+    .def("filter_taps", &Spectralysis::filter_taps)
+    .def("set_mode", &Spectralysis::set_mode, py::arg("mode"))
+    .def("submit", &Spectralysis::submit)
+    .def("poll", &Spectralysis::poll, py::arg("ticket"))
+    .def("wait", &Spectralysis::wait, py::arg("ticket"))
+    .def("process_signal", &Spectralysis::process_signal, py::arg("signal"), py::arg("mask"))
+    .def("chunk_count", &Spectralysis::chunk_count, py::arg("length"))
+    .def("spectrogram", &Spectralysis::spectrogram, py::arg("signal"))
+    .def("load_signal", &Spectralysis::load_signal, py::arg("signal"))
+    .def("load_pcm", &Spectralysis::load_pcm, py::arg("signal"), py::arg("normalize") = false)
+    .def("process_at", &Spectralysis::process_at, py::arg("chunk"), py::arg("mask"))
+    .def("process_analyze_at", &Spectralysis::process_analyze_at, py::arg("chunk"), py::arg("mask"))
     .def("getsize", &Spectralysis::getsize);
 }
 
@@ -212,21 +212,21 @@ drawer = Drawer(pygame.Rect(0, winsize[1] // 2, winsize[0], winsize[1] // 2), py
 speaker = Speaker(pygame.Rect(0, 0, winsize[0], winsize[1] // 2), pygame.Rect(0, 0, 32*nchunks, SPEC_HEIGHT), nchunks)
 
 # Calculate initial spectrogram
-output = np.zeros(out_len, dtype=float)
-out_spec = np.zeros(spec_size, dtype=float)
+# Whole-signal columns are hop apart, chunk c shows CHUNK_SIZE of them from its padded start on
+hop = (out_len - spec_height) // CHUNK_SIZE
+chunk_cols = out_len // hop
+raw_spec = specsis.spectrogram(audiodata)
+filt_spec = specsis.spectrogram(filtdata)
 for chunk in range(nchunks):
-    start = signal_pad + chunk * out_len
-    src_signal = audiodata[start:start + out_len]
-    print(src_signal.shape, out_len)
-    spec = specsis.sdft(src_signal).reshape(-1, spec_height) / spec_height * 2000
+    col = chunk * chunk_cols + spec_height // hop
+    spec = raw_spec[col:col + CHUNK_SIZE] / spec_height * 2000
     spec = np.log(spec + 1) / np.log(100)
     spec[spec > 1] = 1
     drawer.set_bg(chunk, spec)
-    filt_signal = filtdata[chunk * out_len:(chunk + 1) * out_len]
-    print(filt_signal.shape, out_len)
-    if len(filt_signal) < out_len:
+    if (chunk + 1) * out_len > len(filtdata):
         continue
-    spec = specsis.sdft(filt_signal).reshape(-1, spec_height) / spec_height * 2000
+    col = chunk * chunk_cols + signal_pad // hop
+    spec = filt_spec[col:col + CHUNK_SIZE] / spec_height * 2000
     spec = np.log(spec + 1) / np.log(100)
     spec[spec > 1] = 1
     speaker.set_bg(chunk, spec)
@@ -234,12 +234,13 @@ for chunk in range(nchunks):
 drawer.blitmap(window)
 speaker.blitmap(window)
 
+# Chunks are filtered by index from here on, filtdata[i] is sample i of the loaded signal
+specsis.load_signal(audiodata[signal_pad:])
+
 last_time = time.time()
 def filter_chunk(chunk):
     global last_time
     signal_start = out_len * chunk
-    signal_end = signal_start + in_len
-    signal = audiodata[signal_start:signal_end]
 
     masksurf = pygame.Surface((drawer.chunkwidth, drawer.srcsize[1] // 2), pygame.SRCALPHA, 32)
     masksurf.blit(drawer.fg, (0, 0), (chunk * drawer.chunkwidth, 0, drawer.chunkwidth, drawer.srcsize[1] // 2))
@@ -250,16 +251,12 @@ def filter_chunk(chunk):
     print('In between', time.time() - last_time)
     last_time = time.time()
 
-    filt_signal = specsis.process(signal, 255 - mask)
-
-    print('Processing', time.time() - last_time)
-    last_time = time.time()
-
-    spec = specsis.sdft(filt_signal).reshape(-1, spec_height) / spec_height * 2000
+    filt_signal, spec = specsis.process_analyze_at(chunk, 255 - mask)
+    spec = spec.reshape(-1, spec_height) / spec_height * 2000
     spec = np.log(spec + 1) / np.log(100)
     spec[spec > 1] = 1
 
-    print('SDFT', time.time() - last_time)
+    print('Processing and SDFT', time.time() - last_time)
     last_time = time.time()
 
     print('')